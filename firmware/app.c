@@ -42,32 +42,132 @@
 /////////////////////////////////////////////////////////////////////////////
 
 #include <mios32.h>
+#include <string.h>
 #include <eeprom.h>
+#include <FreeRTOS.h>
+#include <task.h>
+#include <semphr.h>
 #include "app.h"
+#include "timebase.h"
+#include "tempo.h"
+#include "clock_out.h"
+#include "master_clock.h"
+#include "midi_in.h"
+#include "midi_out.h"
+#include "pots.h"
+#include "ramp.h"
+#include "sched.h"
+#include "snapshot.h"
+#include "store.h"
+#include "motion.h"
+#include "rytm_dump.h"
+#include "route.h"
+#include "profile.h"
+#include "sysex.h"
+#include "trace.h"
+#include "state_sync.h"
 
 typedef uint8_t bool;
 enum { false = 0, true };
 
 // performance potentiometers
-uint8_t lastValue[12];
-const uint8_t potCC[12] = { 35, 36, 37, 39, 40, 41, 42, 43, 44, 45, 46, 47 };
+uint16_t lastValue[12]; // 14 bit
+
+// resolution of the pot messages: 7 bit CCs (what the performance macros of
+// the Rytm receive) or 14 bit NRPNs. 14 bit CC pairs are not offered, the
+// LSB of CC 35..47 would be the CC numbers 67..79.
+#define POT_OUTPUT_CC   0
+#define POT_OUTPUT_NRPN 1
+#define POT_OUTPUT_MODE POT_OUTPUT_CC
+// NRPN parameter number of the first pot, the others follow consecutively
+#define POT_NRPN_FIRST  0
+// number of bits the 14 bit values lose in the selected resolution
+#if POT_OUTPUT_MODE == POT_OUTPUT_NRPN
+#define POT_OUTPUT_SHIFT 0
+#else
+#define POT_OUTPUT_SHIFT 7
+#endif
+// bytes of one pot message after the status byte (with running status): an
+// NRPN is sent as four CCs
+#if POT_OUTPUT_MODE == POT_OUTPUT_NRPN
+#define POT_MESSAGE_BYTES 8
+#else
+#define POT_MESSAGE_BYTES 2
+#endif
+// a new 7 bit value is only sent once the pot is this far (1/16384 of the
+// range) past the step boundary, so a pot resting on a boundary doesn't toggle
+#define POT_CC_HYSTERESIS 16
+
+// soft takeover: a pot only controls its macro once it has been moved across
+// the value the macro is known to have on the Rytm (or to within this
+// distance of it). Until then, nothing is sent. After power-on the values
+// are unknown, a pot takes over as soon as it is moved.
+#define POT_PICKUP_WINDOW 128
+#define MACRO_UNKNOWN   0xffff
+uint16_t macroValue[12];    // last known value of the macro on the Rytm (14 bit)
+uint16_t potPickedUp;       // bit flags: the pot controls its macro
+uint16_t potAboveMacro;     // bit flags: the pot is above the macro value (not picked up)
 bool performanceKill;
 bool queuedPerformanceKillState;
+// macro values of a recalled snapshot. The values of killed macros wait
+// for the kill release.
+uint16_t queuedMacroValue[12];
+uint16_t queuedMacros;      // bit flags: a value is queued for the macro
+
+// motion recorder: Sync + Kill arms the recording, it starts on the next
+// sync point. Pressed again, the recording ends on the next sync point and
+// the loop is played back. Pressed a third time, the playback stops.
+typedef enum
+{
+    motionIdle = 0,
+    motionArmed,
+    motionRecording,
+    motionFinishing,    // recording until the next sync point
+    motionPlaying
+} motionState_t;
+motionState_t motionState;
+uint8_t motionValues[12];   // 7 bit values sent by the pots, taken by the recorder
+uint8_t playedValues[12];   // 7 bit values of the player
+uint16_t motionPlayed;      // bit flags: the macro follows the player
+u32 motionOrigin;           // song position of the start of the loop
+
+// the profiler results and the trace are sent by the background task, when
+// requested
+volatile bool profileReportRequested;
+volatile bool traceDumpRequested;
+
+// first package of a SysEx on USB0 which may be a command of the controller,
+// 0 if none is held back
+mios32_midi_package_t heldSysEx;
+
+// requests for the settings dump of the Rytm
+u8 dumpRequestsLeft;
+u16 dumpRequestTimer;
 
 // scene changes
-int8_t currentScene;
 const uint8_t sceneCCValue[13] = { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12 };
-int8_t queuedScene;
 
-// track mute states
-uint16_t currentTrackMutes;
-uint16_t queuedTrackMutes;
+// the targets: the instruments which get the scene changes, the track mutes
+// and the macros, each on its own port, channels and CC numbers (see
+// targetMap_t). Each target has its own scene and track mutes, the buttons
+// change those of the selected targets.
+#define TARGET_NUM 2
+typedef struct
+{
+    int8_t currentScene;
+    int8_t queuedScene;
+    uint16_t currentTrackMutes;
+    uint16_t queuedTrackMutes;
+} targetState_t;
+targetState_t target[TARGET_NUM];
+u8 selectedTargets;     // bit flags: the targets the buttons change
 
 // settings
 typedef enum
 {
     syncToMidi1 = 0,
-    syncToRytm
+    syncToInternal = 1, // the values keep settings of older versions (1 bit) valid
+    syncToRytm = 2
 } syncSource_t;
 
 typedef enum
@@ -84,26 +184,79 @@ typedef union
     {
         uint8_t sync:1;     // true == mute, performance kill and scene changes are synced
         uint8_t muteMode:1; // true == buttons change mute states, false == buttons change scene
-        uint8_t syncNominator:5;
-        syncSource_t syncSource:1;
+        uint8_t syncNominator:4;
+        syncSource_t syncSource:2;
         syncDenominator_t syncDenominator:8;
         uint16_t killEnable; // bit flags for enabling kill on selected perf. macros
+        uint8_t syncLead;    // max. number of clock ticks the queued changes may be sent ahead of the sync point (0 == off)
+        uint8_t clockRegen:1; // true == the clock of the sync source is re-generated instead of forwarded
+        rampShape_t rampShape:2;
+        uint8_t rampLength:4; // length of the kill ramps in quarter notes (0 == the macros jump)
+        uint8_t reserved:1;
+        uint16_t masterBpm;  // tempo of the internal master clock in 1/10 BPM
     } readable;
-    uint16_t raw[2];
+    uint16_t raw[4];
 } settings_t;
 settings_t settings;
 
+// filters of the MIDI routing matrix, [source][destination] in the order
+// USB0, UART0 (MIDI 1), UART1 (the Rytm). They are saved with the settings
+// and each route can be loaded by SysEx:
+// F0 7D 52 43 08 <source> <destination> <types> <channels> <first CC> <last CC> F7
+// with the 16 bit flags of the types and of the channels in three bytes
+// each, the top 2 bits first.
+typedef union
+{
+    routeFilter_t filter[ROUTE_NUM_PORTS][ROUTE_NUM_PORTS];
+    uint16_t raw[ROUTE_NUM_PORTS * ROUTE_NUM_PORTS * sizeof(routeFilter_t) / 2];
+} routing_t;
+routing_t routing;
+
+// the default routing: USB and MIDI 1 In are merged into the Rytm, MIDI 1
+// In is also passed to USB. MIDI 1 Out is the THRU of the sync source (see
+// compileRoutes), from the Rytm only its clock and the transport pass.
+#define ROUTE_ALL    { ROUTE_TYPES_ALL, 0xffff, 0, 127 }
+#define ROUTE_NONE   { 0, 0, 0, 0 }
+#define ROUTE_SYSTEM { ROUTE_TYPES_SYSTEM, 0, 0, 0 }
+static const routeFilter_t defaultRouting[ROUTE_NUM_PORTS][ROUTE_NUM_PORTS] =
+{
+    // to USB0    to UART0      to UART1
+    { ROUTE_NONE, ROUTE_ALL,    ROUTE_ALL  },  // from USB0
+    { ROUTE_ALL,  ROUTE_ALL,    ROUTE_ALL  },  // from UART0
+    { ROUTE_NONE, ROUTE_SYSTEM, ROUTE_NONE }   // from UART1
+};
+
 // counters, UI things and other volatile stuff.
-int syncCounter;
-int runTestSyncCounter;
-int syncTimeout;
+int syncCounter;        // clock ticks since the last sync point
+u32 songPosition;       // clock ticks since the start of the song
 int blinkCounter;
 int syncFlashPulseCounter;
+u32 lastSyncEventTime;  // time of the last clock or transport message from the sync source
+bool tempoReported;     // true == the tempo has been reported since the clock has been locked
+u32 predictedSyncTime;  // time the next sync point is expected at
+bool preDispatchArmed;  // true == the next sync point is within the lead time
+u8 preDispatchActions;  // bit flags of the actions due on that sync point
+u32 preDispatchPosition; // song position of that sync point
+u16 publishedBpm;       // tempo sent to the panel (1/10 BPM)
+
+// the queued changes are applied by events on the timer wheel, one per kind
+// of change. The order is the order they are applied in on the same tick.
+typedef enum
+{
+    actionKill = 0,
+    actionScene,
+    actionMutes,
+    actionMacros,
+    NUM_ACTIONS
+} action_t;
+s32 actionEvent[NUM_ACTIONS];   // handle of the scheduled event, -1 == none
 typedef enum
 {
     dontShowSettings = 0,
     showKillEnable,
-    showSyncOptions
+    showSyncOptions,
+    showLatencyOptions,
+    showRampOptions
 } settingsDisplay_t;
 settingsDisplay_t showSettings;
 typedef enum
@@ -116,15 +269,53 @@ bool ignoreNextSyncBttnRelease;
 bool ignoreNextMuteBttnRelease;
 bool syncBttnState;
 bool muteBttnState;
+bool killBttnState;
 
 #define BLINK_MAX       500
 #define SLOW_BLINK      (blinkCounter > BLINK_MAX/2)
 #define FAST_BLINK      ((blinkCounter % BLINK_MAX/2) > BLINK_MAX/4)
 #define FLASH_PULSE     250
 
-#define SYNC_TIMEOUT    500 // 500ms with no clock signal => stopped.
+// the brightness of the LEDs is only rebuilt when one of the values it is
+// built from has changed
+typedef struct
+{
+    settings_t settings;
+    settingsDisplay_t showSettings;
+    u8 selectedTargets;
+    uint16_t currentTrackMutes;
+    uint16_t queuedTrackMutes;
+    int8_t currentScene;
+    int8_t queuedScene;
+    bool performanceKill;
+    bool queuedPerformanceKillState;
+    motionState_t motionState;
+    bool slowBlink;
+    bool fastBlink;
+    bool syncFlash;
+} ledInputs_t;
+ledInputs_t ledInputs;
+#define LED_SR_FIRST    0   // the LEDs are connected to this and the following DOUT SR
+
+// LED brightness by bit angle modulation: bit b of the brightness of all LEDs
+// forms a frame (bit n == DOUT pin n) which is shown for 2^b SRIO scans
+#define LED_BAM_BITS    3
+#define LED_BAM_SLOTS   ((1 << LED_BAM_BITS) - 1)
+#define LED_LEVEL_OFF   0
+#define LED_LEVEL_DIM   1
+#define LED_LEVEL_ON    LED_BAM_SLOTS
+const u8 ledBamPlane[LED_BAM_SLOTS] = { 0, 1, 1, 2, 2, 2, 2 };
+volatile u16 ledPlanes[LED_BAM_BITS];
+u8 ledBamSlot;
+u16 ledFrame;       // frame currently in the DOUT registers
+
+
+
+// settings written by firmware versions before the journaled store: one word
+// per address from 0 on, the oldest ones only contain the first two words
+#define SETTINGS_LEGACY_WORDS 2
+#define SETTINGS_LEGACY_MAX_WORDS 4
 
-#define POT_FIRST       0
 #define SWITCH_FIRST    0
 #define SWITCH_KILL     12
 #define SWITCH_SYNC     13
@@ -138,211 +329,1449 @@ bool muteBttnState;
 #define SCENE_CC        92
 #define MUTE_CC         94
 
+// mapping of a target. The maps are saved with the settings and can be
+// loaded by SysEx: F0 7D 52 43 06 <target> <the 18 bytes below> F7
+typedef enum
+{
+    targetOff = 0,
+    targetUsb0,
+    targetMidi1,            // MIDI 1 Out
+    targetMidi2             // MIDI 2 Out, the Rytm
+} targetPort_t;
+typedef struct __attribute__((packed))
+{
+    uint8_t port;           // targetPort_t
+    uint8_t channel;        // channel of the scene, the kill and the recalled macros
+    uint8_t potChannel;     // channel of the pot movements
+    uint8_t trackChannel;   // channel of track 1, the other tracks follow
+    uint8_t sceneCC;
+    uint8_t muteCC;
+    uint8_t macroCC[12];    // CC numbers of the macros, one per pot
+} targetMap_t;
+typedef union
+{
+    targetMap_t map[TARGET_NUM];
+    uint16_t raw[TARGET_NUM * sizeof(targetMap_t) / 2];
+} targets_t;
+targets_t targets;
+
+// the default: the Rytm on MIDI 2 Out. The second target is off, it only
+// needs a port to drive a second Rytm.
+#define TARGET_RYTM(port) { port, Chn1, Chn15, Chn1, SCENE_CC, MUTE_CC, \
+                            { 35, 36, 37, 39, 40, 41, 42, 43, 44, 45, 46, 47 } }
+static const targetMap_t defaultTargets[TARGET_NUM] =
+{
+    TARGET_RYTM(targetMidi2),
+    TARGET_RYTM(targetOff)
+};
+
+// the tracked tempo is only sent to the panel when it has moved by more than
+// this (1/10 BPM), so the jitter of the clock doesn't cause a stream of deltas
+#define PUBLISHED_BPM_HYSTERESIS 3
+
+// the state of the Rytm is requested at power-on and again each second
+// until it answers
+#define DUMP_REQUESTS         5
+#define DUMP_REQUEST_INTERVAL 1000 // mS
+
+// quantization of the queued changes in clock ticks (24 == 1/4 note). Each
+// kind of change is applied on its own grid, counted from the start of the
+// song. 0 == the sync cycle selected on settings page 2.
+#define SYNC_TICKS_KILL  0
+#define SYNC_TICKS_SCENE 0
+#define SYNC_TICKS_MUTES 0
+#define SYNC_TICKS_MACROS 0
+
+// tempo change per button press on the master clock (1/10 BPM)
+#define MASTER_BPM_STEP 10
+
+// clock multiplier and divider of the re-generated clock
+#define CLOCK_MIDI1_MULTIPLY 1
+#define CLOCK_MIDI1_DIVIDE   1
+#define CLOCK_RYTM_MULTIPLY  1
+#define CLOCK_RYTM_DIVIDE    1
+
+// the sync task drains the realtime events received by the Rx callback
+#define PRIORITY_TASK_SYNC ( tskIDLE_PRIORITY + 3 )
+
+// the application state is changed from the hooks and from the sync task
+xSemaphoreHandle xStateSemaphore;
+#define MUTEX_STATE_TAKE { while( xSemaphoreTakeRecursive(xStateSemaphore, (portTickType)1) != pdTRUE ); }
+#define MUTEX_STATE_GIVE { xSemaphoreGiveRecursive(xStateSemaphore); }
+
+// song position pointers are assembled from their data bytes in the Rx
+// callback, one parser per port the sync source can arrive on
+typedef struct
+{
+    u8 pending;     // number of data bytes still expected
+    u8 lsb;
+} sppParser_t;
+static sppParser_t sppParser[3]; // USB0, UART0, UART1
+
 // local prototypes
 static s32 NOTIFY_MIDI_Rx(mios32_midi_port_t port, u8 midi_byte);
+static s32 handleMidiRx(mios32_midi_port_t port, u8 midi_byte);
+static void handleSysExCommand(s32 command);
+static void forwardPackage(mios32_midi_port_t port, mios32_midi_package_t package);
+static void TASK_Sync(void *pvParameters);
+static bool isSyncSource(mios32_midi_port_t port);
+static bool isRegenerated(mios32_midi_port_t port, mios32_midi_port_t target, mios32_midi_package_t package);
+static void updateClockOut();
+static void handleMasterClockButton(int button);
+static void handleRealtimeEvent(u8 midi_byte, u16 value, u32 time);
+static int syncCycleLength();
+static void syncToSongPosition();
+static void handleButton(u32 pin, u32 pin_value);
+static void sendPotValue(bool fromPot, int pot, u16 value, bool coalesced);
+static void updatePots();
+static bool pickUp(int pot, u16 value);
+static void macroChanged(mios32_midi_port_t port, mios32_midi_package_t package);
 static void triggerSceneSync();
 static void triggerKillSync();
+static u16 killSyncValue(int macro);
+static u16 rampTicks();
+static void sendRampValues(u16 changed);
 static void triggerMuteSync();
+static void triggerMacroSync();
+static void setMacro(int macro, u16 value);
+static void detachPot(int pot, u16 value);
+static void storeSnapshot(int slot);
+static void recallSnapshot(int slot);
+static bool isPending(action_t action);
+static int syncQuantum(action_t action);
+static void triggerAction(action_t action);
+static void scheduleAction(action_t action);
+static void unscheduleAction(action_t action);
+static void rescheduleActions();
+static void fireActions();
+static u8 syncGrid(u32 position);
+static void traceActions(u8 actions, u32 position);
+static void armPreDispatch();
+static void handleMotionButton();
+static void startRecording();
+static void motionTick();
+static void motionRelocated();
+static void playMotion(u16 changed);
+static u32 pendingWireTime(u8 actions);
+static void checkPreDispatch(u32 now);
+static void reportTempo();
+static void requestRytmState();
+static void mirrorRytmState();
+static void publishState();
 static void updateLEDs();
+static void stateLEDLevels(u8 *level);
+static void settingsLEDLevels(u8 *level);
 static void checkEnterSettings();
-static void displaySettings();
 static void storeSettings();
 static void loadSettings();
 static void initSettings();
+static void initRouting();
+static void compileRoutes();
+static mios32_midi_port_t targetPort(int t);
+static int shownTarget();
+static bool isEdited(int t);
+static void selectNextTargets();
+static void loadTargetMap();
+static void sendTargetMap();
+static void loadRoute();
+static void sendRoute();
 
 /////////////////////////////////////////////////////////////////////////////
 // switches the LEDs on or off to indicate the selected scene
 /////////////////////////////////////////////////////////////////////////////
 static void triggerSceneSync()
 {
-    if (queuedScene >= 0)
+    unscheduleAction(actionScene);
+    int t;
+    for (t = 0; t < TARGET_NUM; t++)
     {
-        currentScene = queuedScene;
-        queuedScene = -1;
-        MIOS32_MIDI_SendCC(UART1, Chn1, SCENE_CC, sceneCCValue[currentScene]);
+        targetState_t *s = &target[t];
+        if (s->queuedScene < 0)
+            continue;
+
+        s->currentScene = s->queuedScene;
+        s->queuedScene = -1;
+        if (targetPort(t))
+            MIDI_OUT_SendCC(targetPort(t), targets.map[t].channel, targets.map[t].sceneCC, sceneCCValue[s->currentScene]);
     }
 }
 
 static void triggerKillSync()
 {
+    unscheduleAction(actionKill);
     if (queuedPerformanceKillState != performanceKill)
     {
         performanceKill = queuedPerformanceKillState;
-        if (performanceKill)
+        int i;
+        for (i = 0; i < 12; i++)
         {
-            int i;
-            for (i = 0; i < 12; i++)
+            if (!(settings.readable.killEnable & (1 << i)))
+                continue;
+
+            u16 value = killSyncValue(i);
+            if (!performanceKill && (queuedMacros & (1 << i)))
+            {
+                queuedMacros &= ~(1 << i);
+                detachPot(i, value);
+            }
+            else if (!performanceKill)
+            {
+                potPickedUp |= (1 << i);
+            }
+            if (macroValue[i] == value)
+            {
+                RAMP_Stop(i);
+            }
+            else if (rampTicks())
+            {
+                // the value on the Rytm is unknown until a pot has been moved
+                u16 from = (macroValue[i] == MACRO_UNKNOWN) ? lastValue[i] : macroValue[i];
+                RAMP_Start(i, from, value, rampTicks(), settings.readable.rampShape);
+            }
+            else
             {
-                if (settings.readable.killEnable & (1 << i))
-                    MIOS32_MIDI_SendCC(UART1, Chn1, potCC[i], 0);
+                RAMP_Stop(i);
+                sendPotValue(0, i, value, 0);
+                macroValue[i] = value;
             }
         }
+    }
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// returns the value a kill-enabled macro gets with the queued kill state: 0
+// on the kill. On release, the macros go back to the pots which take over,
+// or to the values of a recalled snapshot.
+/////////////////////////////////////////////////////////////////////////////
+static u16 killSyncValue(int macro)
+{
+    if (queuedPerformanceKillState)
+        return 0;
+    return (queuedMacros & (1 << macro)) ? queuedMacroValue[macro] : lastValue[macro];
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// returns the length of the kill ramps in clock ticks, 0 if the macros jump.
+// The ramps follow the clock, without a running clock they jump as well.
+/////////////////////////////////////////////////////////////////////////////
+static u16 rampTicks()
+{
+    return (runMode == running) ? settings.readable.rampLength * 24 : 0;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// sends the new values of the ramps with the lowest priority. Steps which
+// don't change the value in the selected resolution are not sent.
+/////////////////////////////////////////////////////////////////////////////
+static void sendRampValues(u16 changed)
+{
+    int i;
+    for (i = 0; i < RAMP_NUM; i++)
+    {
+        if (!(changed & (1 << i)))
+            continue;
+
+        u16 value = RAMP_ValueGet(i);
+        if ((value >> POT_OUTPUT_SHIFT) != (macroValue[i] >> POT_OUTPUT_SHIFT))
+            sendPotValue(0, i, value, 1);
+        macroValue[i] = value;
+    }
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// sends the 14 bit value of a pot in the selected resolution to all
+// targets. Values from the pot (or the motion player) go out on the pot
+// channel of the targets, the others on their channel. Coalesced values are
+// sent with the lowest priority.
+/////////////////////////////////////////////////////////////////////////////
+static void sendPotValue(bool fromPot, int pot, u16 value, bool coalesced)
+{
+    int t;
+    for (t = 0; t < TARGET_NUM; t++)
+    {
+        mios32_midi_port_t port = targetPort(t);
+        if (!port)
+            continue;
+        const targetMap_t *map = &targets.map[t];
+        mios32_midi_chn_t chn = fromPot ? map->potChannel : map->channel;
+#if POT_OUTPUT_MODE == POT_OUTPUT_NRPN
+        if (coalesced)
+            MIDI_OUT_SendCoalescedNRPN(port, chn, POT_NRPN_FIRST + pot, value);
+        else
+            MIDI_OUT_SendNRPN(port, chn, POT_NRPN_FIRST + pot, value);
+#else
+        if (coalesced)
+            MIDI_OUT_SendCoalescedCC(port, chn, map->macroCC[pot], value >> 7);
         else
+            MIDI_OUT_SendCC(port, chn, map->macroCC[pot], value >> 7);
+#endif
+    }
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// samples the pots and sends the values which have changed in the selected
+// resolution
+/////////////////////////////////////////////////////////////////////////////
+static void updatePots()
+{
+    u16 changed = POTS_Update();
+    int i;
+    for (i = 0; i < POTS_NUM; i++)
+    {
+        if (!(changed & (1 << i)))
+            continue;
+
+        u16 value = POTS_ValueGet(i);
+#if POT_OUTPUT_MODE == POT_OUTPUT_CC
+        u16 step = lastValue[i] >> 7;
+        if ((value + POT_CC_HYSTERESIS >= (step << 7)) && (value < ((step + 1) << 7) + POT_CC_HYSTERESIS))
+            continue;
+#endif
+        lastValue[i] = value;
+        TRACE_Record(TRACE_POT, i | (value << 8));
+        if (performanceKill && (settings.readable.killEnable & (1 << i)))
+            continue;
+        if (pickUp(i, value))
         {
-            int i;
-            for (i = 0; i < 12; i++)
-                MIOS32_MIDI_SendCC(UART1, Chn1, potCC[i], lastValue[i]);
+            RAMP_Stop(i);
+            motionValues[i] = value >> 7;
+            motionPlayed &= ~(1 << i);
+            sendPotValue(1, i, value, 1);
+            macroValue[i] = value;
+        }
+    }
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// returns true if the pot controls its macro, checks if it takes over
+/////////////////////////////////////////////////////////////////////////////
+static bool pickUp(int pot, u16 value)
+{
+    if (potPickedUp & (1 << pot))
+        return true;
+
+    u16 macro = macroValue[pot];
+    bool above = value > macro;
+    bool wasAbove = (potAboveMacro & (1 << pot)) ? 1 : 0;
+    if ((macro == MACRO_UNKNOWN) || (above != wasAbove)
+        || (value + POT_PICKUP_WINDOW > macro && value < macro + POT_PICKUP_WINDOW))
+    {
+        potPickedUp |= (1 << pot);
+        return true;
+    }
+    return false;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// the pot has to pick up its macro again if the macro is set to a value
+// away from the pot
+/////////////////////////////////////////////////////////////////////////////
+static void detachPot(int pot, u16 value)
+{
+    if ((lastValue[pot] + POT_PICKUP_WINDOW <= value) || (lastValue[pot] >= value + POT_PICKUP_WINDOW))
+    {
+        potPickedUp &= ~(1 << pot);
+        if (lastValue[pot] > value)
+            potAboveMacro |= (1 << pot);
+        else
+            potAboveMacro &= ~(1 << pot);
+    }
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// tracks a macro CC which reaches a target from elsewhere (MIDI thru) or
+// which the Rytm reports on the port of its target. It stops a running ramp
+// of the macro. If it moves the macro away from its pot, the pot has to pick
+// it up again.
+/////////////////////////////////////////////////////////////////////////////
+static void macroChanged(mios32_midi_port_t port, mios32_midi_package_t package)
+{
+    if (package.type != CC)
+        return;
+
+    int t, i;
+    for (t = 0; t < TARGET_NUM; t++)
+    {
+        const targetMap_t *map = &targets.map[t];
+        if ((targetPort(t) != port) || ((package.chn != map->channel) && (package.chn != map->potChannel)))
+            continue;
+
+        for (i = 0; i < 12; i++)
+        {
+            if (map->macroCC[i] != package.cc_number)
+                continue;
+
+            RAMP_Stop(i);
+            macroValue[i] = package.value << 7;
+            detachPot(i, macroValue[i]);
+            return;
         }
     }
 }
 
 static void triggerMuteSync()
 {
+    unscheduleAction(actionMutes);
+    int t, i;
+    for (t = 0; t < TARGET_NUM; t++)
+    {
+        targetState_t *s = &target[t];
+        const targetMap_t *map = &targets.map[t];
+        mios32_midi_port_t port = targetPort(t);
+        for (i = 0; i < 12; i++)
+        {
+            bool isMuted = (s->currentTrackMutes & (1<<i))?1:0;
+            bool isQueued = (s->queuedTrackMutes & (1<<i))?1:0;
+            if ((isMuted != isQueued) && port)
+            {
+                MIDI_OUT_SendCC(port, map->trackChannel + i, map->muteCC, isQueued?127:0);
+            }
+        }
+        s->currentTrackMutes = s->queuedTrackMutes;
+    }
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// sets the macros to the values of a recalled snapshot. The values of
+// killed macros stay queued until the kill is released.
+/////////////////////////////////////////////////////////////////////////////
+static void triggerMacroSync()
+{
+    unscheduleAction(actionMacros);
+    u16 killed = performanceKill ? settings.readable.killEnable : 0;
     int i;
     for (i = 0; i < 12; i++)
     {
-        bool isMuted = (currentTrackMutes & (1<<i))?1:0;
-        bool isQueued = (queuedTrackMutes & (1<<i))?1:0;
-        if (isMuted != isQueued)
+        if (!(queuedMacros & (1 << i)) || (killed & (1 << i)))
+            continue;
+
+        queuedMacros &= ~(1 << i);
+        setMacro(i, queuedMacroValue[i]);
+    }
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// sets a macro to a value, only sends it if it differs from the value the
+// macro is known to have
+/////////////////////////////////////////////////////////////////////////////
+static void setMacro(int macro, u16 value)
+{
+    RAMP_Stop(macro);
+    if ((value >> POT_OUTPUT_SHIFT) != (macroValue[macro] >> POT_OUTPUT_SHIFT))
+        sendPotValue(0, macro, value, 0);
+    macroValue[macro] = value;
+    detachPot(macro, value);
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// stores the current state in a snapshot slot. Killed macros are stored
+// with the value they get back on the kill release, macros whose value is
+// unknown (not moved since power-on) are left as they are on a recall.
+/////////////////////////////////////////////////////////////////////////////
+static void storeSnapshot(int slot)
+{
+    snapshot_t snapshot;
+    snapshot.performanceKill = performanceKill;
+    // the scene and the track mutes of each target
+    snapshot.scene = target[0].currentScene;
+    snapshot.trackMutes = target[0].currentTrackMutes;
+    snapshot.scene2 = target[1].currentScene;
+    snapshot.trackMutes2 = target[1].currentTrackMutes;
+    int i;
+    for (i = 0; i < 12; i++)
+    {
+        if (queuedMacros & (1 << i))
+            snapshot.macros[i] = queuedMacroValue[i];
+        else if (performanceKill && (settings.readable.killEnable & (1 << i)))
+            snapshot.macros[i] = lastValue[i];
+        else
+            snapshot.macros[i] = macroValue[i];
+    }
+
+    if (SNAPSHOT_Store(slot, &snapshot) < 0)
+        MIOS32_MIDI_SendDebugMessage("Error storing snapshot %d.", slot + 1);
+    else
+        MIOS32_MIDI_SendDebugMessage("Snapshot %d stored.", slot + 1);
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// queues the state of a snapshot slot like changes made on the buttons.
+// Only what differs from the current state is sent.
+/////////////////////////////////////////////////////////////////////////////
+static void recallSnapshot(int slot)
+{
+    snapshot_t snapshot;
+    s32 result = SNAPSHOT_Load(slot, &snapshot);
+    if (result == -2)
+        MIOS32_MIDI_SendDebugMessage("Snapshot %d is empty.", slot + 1);
+    else if (result < 0)
+        MIOS32_MIDI_SendDebugMessage("Error reading snapshot %d.", slot + 1);
+    if (result < 0)
+        return;
+
+    // each selected target gets its own scene and track mutes back
+    const s8 scene[TARGET_NUM] = { snapshot.scene, snapshot.scene2 };
+    const u16 trackMutes[TARGET_NUM] = { snapshot.trackMutes, snapshot.trackMutes2 };
+    int t;
+    for (t = 0; t < TARGET_NUM; t++)
+    {
+        if (!isEdited(t))
+            continue;
+        targetState_t *s = &target[t];
+        if (trackMutes[t] != SNAPSHOT_MUTES_UNKNOWN)
+            s->queuedTrackMutes = trackMutes[t] & 0x0fff;
+        if ((scene[t] >= 0) && (scene[t] <= 12))
+            s->queuedScene = (scene[t] != s->currentScene) ? scene[t] : -1;
+    }
+    queuedPerformanceKillState = snapshot.performanceKill ? 1 : 0;
+    int i;
+    queuedMacros = 0;
+    for (i = 0; i < 12; i++)
+    {
+        if (snapshot.macros[i] == MACRO_UNKNOWN)
+            continue;
+        queuedMacroValue[i] = snapshot.macros[i] & 0x3fff;
+        queuedMacros |= (1 << i);
+    }
+
+    for (i = 0; i < NUM_ACTIONS; i++)
+    {
+        if (!settings.readable.sync || runMode == stopped)
+            triggerAction(i);
+        else if (isPending(i))
+            scheduleAction(i);
+    }
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// returns true if a change of this kind is queued
+/////////////////////////////////////////////////////////////////////////////
+static bool isPending(action_t action)
+{
+    int t;
+    switch (action)
+    {
+        case actionKill:
+            return queuedPerformanceKillState != performanceKill;
+        case actionScene:
+            for (t = 0; t < TARGET_NUM; t++)
+                if (target[t].queuedScene >= 0)
+                    return 1;
+            return 0;
+        case actionMutes:
+            for (t = 0; t < TARGET_NUM; t++)
+                if ((target[t].currentTrackMutes ^ target[t].queuedTrackMutes) & 0x0fff)
+                    return 1;
+            return 0;
+        default:
+            return (queuedMacros & ~(performanceKill ? settings.readable.killEnable : 0)) ? 1 : 0;
+    }
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// returns the grid (clock ticks) the changes of this kind are applied on
+/////////////////////////////////////////////////////////////////////////////
+static int syncQuantum(action_t action)
+{
+    static const int quantum[NUM_ACTIONS] = { SYNC_TICKS_KILL, SYNC_TICKS_SCENE, SYNC_TICKS_MUTES, SYNC_TICKS_MACROS };
+    return quantum[action] ? quantum[action] : syncCycleLength();
+}
+
+static void triggerAction(action_t action)
+{
+    switch (action)
+    {
+        case actionKill:
+            triggerKillSync();
+            break;
+        case actionScene:
+            triggerSceneSync();
+            break;
+        case actionMutes:
+            triggerMuteSync();
+            break;
+        default:
+            triggerMacroSync();
+            break;
+    }
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// schedules the queued changes of a kind on the next point of their grid.
+// Further changes of the same kind join the scheduled event.
+/////////////////////////////////////////////////////////////////////////////
+static void scheduleAction(action_t action)
+{
+    if (actionEvent[action] >= 0)
+        return;
+
+    int quantum = syncQuantum(action);
+    actionEvent[action] = SCHED_Insert(quantum - (songPosition % quantum), action, 0);
+    armPreDispatch();
+}
+
+static void unscheduleAction(action_t action)
+{
+    if (actionEvent[action] >= 0)
+    {
+        SCHED_Cancel(actionEvent[action]);
+        actionEvent[action] = -1;
+    }
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// moves the queued changes to the grid points of the current song position
+/////////////////////////////////////////////////////////////////////////////
+static void rescheduleActions()
+{
+    int i;
+    for (i = 0; i < NUM_ACTIONS; i++)
+    {
+        unscheduleAction(i);
+        if ((runMode == running) && isPending(i))
+            scheduleAction(i);
+    }
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// applies the changes whose events are due on this clock tick
+/////////////////////////////////////////////////////////////////////////////
+static void fireActions()
+{
+    u8 due = 0;
+    schedEvent_t event;
+    while (SCHED_Pop(&event))
+    {
+        due |= (1 << event.action);
+        actionEvent[event.action] = -1;
+    }
+
+    traceActions(due, songPosition);
+    int i;
+    for (i = 0; i < NUM_ACTIONS; i++)
+        if (due & (1 << i))
+            triggerAction(i);
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// returns the bit flags of the actions which have a sync point at the given
+// song position
+/////////////////////////////////////////////////////////////////////////////
+static u8 syncGrid(u32 position)
+{
+    u8 actions = 0;
+    int i;
+    for (i = 0; i < NUM_ACTIONS; i++)
+        if ((position % syncQuantum(i)) == 0)
+            actions |= (1 << i);
+    return actions;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// records the queued changes which are about to be applied for the sync
+// point at the given song position
+/////////////////////////////////////////////////////////////////////////////
+static void traceActions(u8 actions, u32 position)
+{
+    u8 pending = 0;
+    int i;
+    for (i = 0; i < NUM_ACTIONS; i++)
+        if ((actions & (1 << i)) && isPending(i))
+            pending |= (1 << i);
+    if (pending)
+        TRACE_Record(TRACE_ACTION, pending | ((position & 0xffff) << 8));
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// arms the pre-dispatch if the next scheduled changes are due within the
+// lead time
+/////////////////////////////////////////////////////////////////////////////
+static void armPreDispatch()
+{
+    preDispatchArmed = 0;
+    if (!settings.readable.sync || !TEMPO_IntervalGet())
+        return;
+
+    u32 ticks = settings.readable.syncLead + 1;
+    int i;
+    for (i = 0; i < NUM_ACTIONS; i++)
+    {
+        if (actionEvent[i] < 0)
+            continue;
+
+        u32 left = SCHED_TicksLeft(actionEvent[i]);
+        if (left < ticks)
         {
-            MIOS32_MIDI_SendCC(UART1, Chn1 + i, MUTE_CC, isQueued?127:0);
+            ticks = left;
+            preDispatchActions = 0;
         }
+        if (left == ticks)
+            preDispatchActions |= (1 << i);
+    }
+
+    if (ticks <= settings.readable.syncLead)
+    {
+        predictedSyncTime = TEMPO_PredictTime(ticks);
+        preDispatchPosition = songPosition + ticks;
+        preDispatchArmed = 1;
     }
-    currentTrackMutes = queuedTrackMutes;
 }
 
+static int countBits(uint16_t value)
+{
+    int count = 0;
+    for (; value; value &= value - 1)
+        count++;
+    return count;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// Sync + Kill: arms the motion recorder, ends the recording, stops the
+// playback
+/////////////////////////////////////////////////////////////////////////////
+static void handleMotionButton()
+{
+    switch (motionState)
+    {
+        case motionIdle:
+            motionState = motionArmed;
+            MIOS32_MIDI_SendDebugMessage("Motion recorder: armed");
+            break;
+        case motionArmed:
+            motionState = motionIdle;
+            MIOS32_MIDI_SendDebugMessage("Motion recorder: off");
+            break;
+        case motionRecording:
+            motionState = motionFinishing;
+            break;
+        case motionFinishing:
+            break;
+        default:
+            motionState = motionIdle;
+            motionPlayed = 0;
+            MIOS32_MIDI_SendDebugMessage("Motion recorder: stopped");
+            break;
+    }
+}
+
+static void startRecording()
+{
+    MOTION_RecordStart(motionValues);
+    motionOrigin = songPosition;
+    motionState = motionRecording;
+    MIOS32_MIDI_SendDebugMessage("Motion recorder: recording");
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// runs the motion recorder for one clock tick. Recordings start and end on
+// the sync points, so the loop is a multiple of the sync cycle.
+/////////////////////////////////////////////////////////////////////////////
+static void motionTick()
+{
+    bool syncPoint = (syncCounter == 0);
+    if ((motionState == motionFinishing) && syncPoint)
+    {
+        u32 length = MOTION_RecordStop();
+        motionState = motionPlaying;
+        motionPlayed = MOTION_PotsGet();
+        memcpy(playedValues, motionValues, sizeof(playedValues));
+        playMotion(MOTION_PlaySeek(0, playedValues));
+        MIOS32_MIDI_SendDebugMessage("Motion recorder: playing %d ticks (%d bytes)", length, MOTION_BytesGet());
+    }
+    else if ((motionState == motionRecording) || (motionState == motionFinishing))
+    {
+        if (MOTION_RecordTick(motionValues) < 0)
+        {
+            motionState = motionIdle;
+            MIOS32_MIDI_SendDebugMessage("Motion recorder: out of memory, recording stopped");
+        }
+    }
+    else if (motionState == motionPlaying)
+        playMotion(MOTION_PlayTick(playedValues));
+    else if ((motionState == motionArmed) && syncPoint)
+        startRecording();
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// follows a jump of the song position (start, continue, song position
+// pointer). A recording starts over, the player continues at the position
+// of the loop which corresponds to the song position.
+/////////////////////////////////////////////////////////////////////////////
+static void motionRelocated()
+{
+    if ((motionState == motionRecording) || (motionState == motionFinishing))
+        motionState = motionArmed;
+
+    if ((motionState == motionArmed) && (runMode == running) && (syncCounter == 0))
+        startRecording();
+    else if (motionState == motionPlaying)
+    {
+        u32 length = MOTION_LengthGet();
+        u32 position = ((songPosition % length) + length - (motionOrigin % length)) % length;
+        playMotion(MOTION_PlaySeek(position, playedValues));
+    }
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// sends the values of the player with the lowest priority. Macros which
+// are killed or which a pot has taken over are left alone.
+/////////////////////////////////////////////////////////////////////////////
+static void playMotion(u16 changed)
+{
+    u16 killed = performanceKill ? settings.readable.killEnable : 0;
+    changed &= motionPlayed & ~killed;
+    int i;
+    for (i = 0; i < 12; i++)
+    {
+        if (!(changed & (1 << i)))
+            continue;
+
+        u16 value = playedValues[i] << 7;
+        RAMP_Stop(i);
+        if ((value >> POT_OUTPUT_SHIFT) != (macroValue[i] >> POT_OUTPUT_SHIFT))
+            sendPotValue(1, i, value, 1);
+        macroValue[i] = value;
+        detachPot(i, value);
+    }
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// returns the time it takes to send the queued changes of the given kinds
+// (bit flags) to the targets in uS, or 0 if nothing is queued. Each UART
+// has its own queue, the slowest one determines the time.
+/////////////////////////////////////////////////////////////////////////////
+static u32 pendingWireTime(u8 actions)
+{
+    // the kill and the macros go to all targets. Only the kill-enabled
+    // macros whose value changes are sent, sharing one status byte (running
+    // status). A ramp only starts on the sync point, it doesn't send anything
+    // ahead of it.
+    u32 shared = 0;
+    if ((actions & (1 << actionKill)) && (queuedPerformanceKillState != performanceKill) && !rampTicks())
+    {
+        int i, macros = 0;
+        for (i = 0; i < 12; i++)
+            if ((settings.readable.killEnable & (1 << i)) && (killSyncValue(i) != macroValue[i]))
+                macros++;
+        if (macros)
+            shared += 1 + POT_MESSAGE_BYTES * macros;
+    }
+    if (actions & (1 << actionMacros))
+    {
+        // recalled macros which differ, with running status
+        u16 killed = performanceKill ? settings.readable.killEnable : 0;
+        int i, macros = 0;
+        for (i = 0; i < 12; i++)
+            if ((queuedMacros & ~killed & (1 << i))
+                && ((queuedMacroValue[i] >> POT_OUTPUT_SHIFT) != (macroValue[i] >> POT_OUTPUT_SHIFT)))
+                macros++;
+        if (macros)
+            shared += 1 + POT_MESSAGE_BYTES * macros;
+    }
+
+    u32 bytes[2] = { 0, 0 }; // UART0, UART1
+    int t;
+    for (t = 0; t < TARGET_NUM; t++)
+    {
+        mios32_midi_port_t port = targetPort(t);
+        if ((port != UART0) && (port != UART1))
+            continue; // USB doesn't wait for a wire
+        u32 *b = &bytes[port - UART0];
+        if ((actions & (1 << actionScene)) && (target[t].queuedScene >= 0))
+            *b += 3;
+        if (actions & (1 << actionMutes))
+            *b += 3 * countBits((target[t].currentTrackMutes ^ target[t].queuedTrackMutes) & 0x0fff);
+        *b += shared;
+    }
+
+    u32 wireTime = 0;
+    int i;
+    for (i = 0; i < 2; i++)
+    {
+        if (!bytes[i])
+            continue;
+        // whatever is still waiting for the UART goes out first
+        u32 time = (bytes[i] + MIDI_OUT_PendingBytes(UART0 + i)) * MIDI_OUT_BYTE_US;
+        if (time > wireTime)
+            wireTime = time;
+    }
+    return wireTime;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// sends the queued changes ahead of the sync point, early enough for the
+// last byte to arrive at the Rytm on the sync point itself. It is called
+// each mS, the changes go out on the last call which is still in time.
+/////////////////////////////////////////////////////////////////////////////
+static void checkPreDispatch(u32 now)
+{
+    if (!preDispatchArmed)
+        return;
+
+    u32 wireTime = pendingWireTime(preDispatchActions);
+    if (wireTime && (s32)(now + 1000 + wireTime - predictedSyncTime) >= 0)
+    {
+        traceActions(preDispatchActions & ~(rampTicks() ? (1 << actionKill) : 0), preDispatchPosition);
+        if ((preDispatchActions & (1 << actionKill)) && !rampTicks())
+            triggerKillSync();
+        if (preDispatchActions & (1 << actionScene))
+            triggerSceneSync();
+        if (preDispatchActions & (1 << actionMutes))
+            triggerMuteSync();
+        if (preDispatchActions & (1 << actionMacros))
+            triggerMacroSync();
+        MIDI_OUT_Flush();
+        armPreDispatch();
+    }
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// requests the settings dump of the Rytm
+/////////////////////////////////////////////////////////////////////////////
+static void requestRytmState()
+{
+    RYTM_DUMP_Request(UART1);
+    dumpRequestsLeft--;
+    dumpRequestTimer = DUMP_REQUEST_INTERVAL;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// takes over the track mutes and the scene of the settings dump for the
+// targets on MIDI 2 Out. Changes which are still queued are kept.
+/////////////////////////////////////////////////////////////////////////////
+static void mirrorRytmState()
+{
+    int t;
+    for (t = 0; t < TARGET_NUM; t++)
+    {
+        if (targetPort(t) != UART1)
+            continue;
+        targetState_t *s = &target[t];
+        u16 toggled = s->queuedTrackMutes ^ s->currentTrackMutes;
+        s->currentTrackMutes = RYTM_DUMP_MutesGet() & 0x0fff;
+        s->queuedTrackMutes = s->currentTrackMutes ^ toggled;
+        s->currentScene = RYTM_DUMP_SceneGet();
+    }
+    dumpRequestsLeft = 0;
+    MIOS32_MIDI_SendDebugMessage("Rytm state: track mutes %03X, scene %d", RYTM_DUMP_MutesGet() & 0x0fff, RYTM_DUMP_SceneGet());
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// prints the tracked tempo of the sync source
+/////////////////////////////////////////////////////////////////////////////
+static void reportTempo()
+{
+    u32 bpm = TEMPO_BpmGet();
+    MIOS32_MIDI_SendDebugMessage("Tempo: %d.%d BPM, jitter %d uS", bpm / 10, bpm % 10, TEMPO_JitterGet());
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// selects the ports which get the re-generated clock: all ports which would
+// otherwise forward the clock of the sync source
+/////////////////////////////////////////////////////////////////////////////
+static void updateClockOut()
+{
+    bool regen = settings.readable.clockRegen && (settings.readable.syncSource != syncToInternal);
+    CLOCK_OUT_PortSet(UART0, regen, CLOCK_MIDI1_MULTIPLY, CLOCK_MIDI1_DIVIDE);
+    CLOCK_OUT_PortSet(UART1, regen && (settings.readable.syncSource == syncToMidi1),
+                      CLOCK_RYTM_MULTIPLY, CLOCK_RYTM_DIVIDE);
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// buttons 1-4 while Sync is held, with the internal master clock:
+// tempo down, tempo up, start/stop, tap tempo
+/////////////////////////////////////////////////////////////////////////////
+static void handleMasterClockButton(int button)
+{
+    if (button == 0)
+        MASTER_CLOCK_BpmSet(MASTER_CLOCK_BpmGet() - MASTER_BPM_STEP);
+    else if (button == 1)
+        MASTER_CLOCK_BpmSet(MASTER_CLOCK_BpmGet() + MASTER_BPM_STEP);
+    else if (button == 2)
+    {
+        if (MASTER_CLOCK_IsRunning())
+            MASTER_CLOCK_Stop();
+        else
+            MASTER_CLOCK_Start();
+        return;
+    }
+    else if (button == 3)
+    {
+        // the first tap only starts the measurement
+        if (!MASTER_CLOCK_Tap(TIMEBASE_Get()))
+            return;
+    }
+    else
+        return;
+
+    settings.readable.masterBpm = MASTER_CLOCK_BpmGet();
+    MIOS32_MIDI_SendDebugMessage("Master clock: %d BPM", settings.readable.masterBpm / 10);
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// hands the state to the state sync protocol, which sends the changes to a
+// subscribed panel (see state_sync.h for the layout)
+/////////////////////////////////////////////////////////////////////////////
+static void publishState()
+{
+    u8 state[STATE_BYTES];
+
+    // the scene and the track mutes of each target, in the same layout
+    static const u8 targetFields[TARGET_NUM] = { STATE_SCENE, STATE_TARGET_2 };
+    int t;
+    for (t = 0; t < TARGET_NUM; t++)
+    {
+        const targetState_t *s = &target[t];
+        u8 *f = &state[targetFields[t]];
+        f[STATE_SCENE] = (s->currentScene >= 0) ? s->currentScene : 127;
+        f[STATE_QUEUED_SCENE] = (s->queuedScene >= 0) ? s->queuedScene : 127;
+        f[STATE_MUTES] = s->currentTrackMutes & 0x7f;
+        f[STATE_MUTES + 1] = (s->currentTrackMutes >> 7) & 0x1f;
+        f[STATE_QUEUED_MUTES] = s->queuedTrackMutes & 0x7f;
+        f[STATE_QUEUED_MUTES + 1] = (s->queuedTrackMutes >> 7) & 0x1f;
+    }
+    state[STATE_SELECTED] = selectedTargets;
+    state[STATE_FLAGS] = (performanceKill ? STATE_FLAG_KILL : 0)
+                       | (queuedPerformanceKillState ? STATE_FLAG_QUEUED_KILL : 0)
+                       | ((runMode == running) ? STATE_FLAG_RUNNING : 0)
+                       | (showSettings ? STATE_FLAG_SETTINGS : 0);
+
+    u32 bpm = 0;
+    if (settings.readable.syncSource == syncToInternal)
+        bpm = settings.readable.masterBpm;
+    else if (TEMPO_IsLocked())
+        bpm = TEMPO_BpmGet();
+    if (!bpm || !publishedBpm || (bpm > publishedBpm + PUBLISHED_BPM_HYSTERESIS)
+        || (bpm + PUBLISHED_BPM_HYSTERESIS < publishedBpm) || (settings.readable.syncSource == syncToInternal))
+        publishedBpm = (bpm < 0x3fff) ? bpm : 0x3fff;
+    state[STATE_TEMPO] = publishedBpm >> 7;
+    state[STATE_TEMPO + 1] = publishedBpm & 0x7f;
+
+    u64 bits = 0;
+    int i;
+    for (i = 0; i < 4; i++)
+        bits |= (u64)settings.raw[i] << (16 * i);
+    for (i = 0; i < STATE_SETTINGS_BYTES; i++)
+        state[STATE_SETTINGS + i] = (bits >> (7 * i)) & 0x7f;
+
+    STATE_SYNC_Update(state);
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// rebuilds the brightness of the LEDs if anything they show has changed and
+// hands the bit planes to the SRIO hooks
+/////////////////////////////////////////////////////////////////////////////
 static void updateLEDs()
 {
+    ledInputs_t inputs;
+    memset(&inputs, 0, sizeof(ledInputs_t)); // clears the padding for memcmp
+    inputs.settings = settings;
+    inputs.showSettings = showSettings;
+    inputs.selectedTargets = selectedTargets;
+    // the LEDs show the first of the selected targets
+    const targetState_t *s = &target[shownTarget()];
+    inputs.currentTrackMutes = s->currentTrackMutes;
+    inputs.queuedTrackMutes = s->queuedTrackMutes;
+    inputs.currentScene = s->currentScene;
+    inputs.queuedScene = s->queuedScene;
+    inputs.performanceKill = performanceKill;
+    inputs.queuedPerformanceKillState = queuedPerformanceKillState;
+    inputs.slowBlink = SLOW_BLINK;
+    inputs.motionState = motionState;
+    // only the settings pages and the motion recorder blink fast
+    inputs.fastBlink = (showSettings || (motionState == motionRecording) || (motionState == motionFinishing)) ? FAST_BLINK : 0;
+    inputs.syncFlash = syncFlashPulseCounter > FLASH_PULSE/2;
+    if (!memcmp(&inputs, &ledInputs, sizeof(ledInputs_t)))
+        return;
+    ledInputs = inputs;
+
+    u8 level[16];
+    memset(level, LED_LEVEL_OFF, sizeof(level));
+    if (showSettings)
+        settingsLEDLevels(level);
+    else
+        stateLEDLevels(level);
+
+    // bit b of all brightness values forms plane b
+    u16 planes[LED_BAM_BITS];
+    int b, i;
+    for (b = 0; b < LED_BAM_BITS; b++)
+    {
+        planes[b] = 0;
+        for (i = 0; i < 16; i++)
+            if (level[i] & (1 << b))
+                planes[b] |= (1 << i);
+    }
+
+    MIOS32_IRQ_Disable();
+    for (b = 0; b < LED_BAM_BITS; b++)
+        ledPlanes[b] = planes[b];
+    MIOS32_IRQ_Enable();
+}
+
+static void stateLEDLevels(u8 *level)
+{
+    const targetState_t *s = &target[shownTarget()];
+    int i;
     if (settings.readable.muteMode)
     {
-        MIOS32_DOUT_PinSet(LED_MUTEMODE, 1);
+        level[LED_MUTEMODE] = LED_LEVEL_ON;
 
-        // turn on the led for each unmuted track
-        int i;
+        // turn on the led for each unmuted track, dimmed if it is going to change
         for (i = 0; i < 12; i++)
         {
-            bool isMuted = (currentTrackMutes & (1<<i))?1:0;
-            bool isQueued = (queuedTrackMutes & (1<<i))?1:0;
+            bool isMuted = (s->currentTrackMutes & (1<<i))?1:0;
+            bool isQueued = (s->queuedTrackMutes & (1<<i))?1:0;
             if (isMuted != isQueued)
-            {
-                MIOS32_DOUT_PinSet(i, FAST_BLINK?1:0);
-            }
-            else
-            {
-                MIOS32_DOUT_PinSet(i, isMuted?0:1);
-            }
+                level[i] = LED_LEVEL_DIM;
+            else if (!isMuted)
+                level[i] = LED_LEVEL_ON;
         }
     }
     else
     {
-        MIOS32_DOUT_PinSet(LED_MUTEMODE, 0);
-
         // turn on the led for the selected scene
-        int i;
+        if (s->currentScene > 0)
+            level[s->currentScene - 1] = LED_LEVEL_ON;
+        // if there's a scene change queued - display that dimmed
+        if ((s->queuedScene == 0) && (s->currentScene > 0))
+            level[s->currentScene - 1] = LED_LEVEL_DIM; // soon switching off the scene
+        else if (s->queuedScene > 0)
+            level[s->queuedScene - 1] = LED_LEVEL_DIM;
+    }
+
+    // turn on the led for the kill state
+    // if there's a kill state change queued - display that dimmed
+    if (queuedPerformanceKillState != performanceKill)
+        level[LED_KILL] = LED_LEVEL_DIM;
+    else if (performanceKill)
+        level[LED_KILL] = LED_LEVEL_ON;
+
+    // the motion recorder blinks slowly while armed, fast while recording
+    if (motionState == motionArmed)
+        level[LED_KILL] = SLOW_BLINK ? LED_LEVEL_ON : LED_LEVEL_OFF;
+    else if ((motionState == motionRecording) || (motionState == motionFinishing))
+        level[LED_KILL] = FAST_BLINK ? LED_LEVEL_ON : LED_LEVEL_OFF;
+
+    // when synced: led is on, briefly flashes of on the sync point
+    // if no tempo signal is present, flash continuously
+    if (settings.readable.sync && (syncFlashPulseCounter <= FLASH_PULSE/2))
+        level[LED_SYNC] = LED_LEVEL_ON;
+}
+
+static void settingsLEDLevels(u8 *level)
+{
+    int i;
+    level[LED_SYNC] = LED_LEVEL_ON;
+    if (showSettings == showKillEnable)
+    {
+        if (SLOW_BLINK)
+            level[LED_KILL] = LED_LEVEL_ON;
+        // the buttons change: on: all targets, off: the first, flashing: the second
+        if ((selectedTargets == (1 << 1)) ? FAST_BLINK : (selectedTargets != (1 << 0)))
+            level[LED_MUTEMODE] = LED_LEVEL_ON;
         for (i = 0; i < 12; i++)
-            MIOS32_DOUT_PinSet(i, (i==(currentScene - 1))?1:0);
-        // if there's a scene change queued - display that
-        if (queuedScene >= 0)
+            if (settings.readable.killEnable & (1 << i))
+                level[i] = LED_LEVEL_ON;
+    }
+    else if (showSettings == showSyncOptions)
+    {
+        // on: MIDI 1, off: Rytm, flashing: internal master clock
+        if ((settings.readable.syncSource == syncToInternal) ? FAST_BLINK : (settings.readable.syncSource == syncToMidi1))
+            level[LED_KILL] = LED_LEVEL_ON;
+        if (SLOW_BLINK)
+            level[LED_MUTEMODE] = LED_LEVEL_ON;
+
+        for (i = 0; i < 4; i++)
+            if (settings.readable.syncDenominator & (1 << i))
+                level[i] = LED_LEVEL_ON;
+        if ((settings.readable.syncNominator >= 4) && (settings.readable.syncNominator < 12))
+            level[settings.readable.syncNominator] = LED_LEVEL_ON;
+    }
+    else if (showSettings == showLatencyOptions)
+    {
+        if (settings.readable.clockRegen)
+            level[LED_KILL] = LED_LEVEL_ON;
+        if (SLOW_BLINK)
+            level[LED_MUTEMODE] = LED_LEVEL_ON;
+
+        // the lead time is displayed as a bar
+        for (i = 0; i < 12; i++)
+            if (i < settings.readable.syncLead)
+                level[i] = LED_LEVEL_ON;
+    }
+    else
+    {
+        // on: linear, off: curved, flashing: S-curve
+        if ((settings.readable.rampShape == rampSCurve) ? FAST_BLINK : (settings.readable.rampShape == rampLinear))
+            level[LED_KILL] = LED_LEVEL_ON;
+        if (FAST_BLINK)
+            level[LED_MUTEMODE] = LED_LEVEL_ON;
+
+        // the ramp length is displayed as a bar
+        for (i = 0; i < 12; i++)
+            if (i < settings.readable.rampLength)
+                level[i] = LED_LEVEL_ON;
+    }
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// stores the settings in the journal, only if they have changed
+/////////////////////////////////////////////////////////////////////////////
+static void storeSettings()
+{
+    int32_t result = STORE_Save(STORE_SETTINGS, settings.raw, sizeof(settings_t)/2);
+    if (result >= 0)
+        result = STORE_Save(STORE_ROUTES, routing.raw, sizeof(routing_t)/2);
+    if (result >= 0)
+        result = STORE_Save(STORE_TARGETS, targets.raw, sizeof(targets_t)/2);
+
+    if (result == -1)
+        MIOS32_MIDI_SendDebugMessage("Error writing settings: Page is full.");
+    else if (result == -2)
+        MIOS32_MIDI_SendDebugMessage("Error writing settings: No valid page was found.");
+    else if (result == -3)
+        MIOS32_MIDI_SendDebugMessage("Error writing settings: Flash write error.");
+    else if (result < 0)
+        MIOS32_MIDI_SendDebugMessage("Error writing settings: Unknown error %d.", result);
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// loads the newest valid settings record. If there is none, the settings
+// of an older firmware version are taken over.
+/////////////////////////////////////////////////////////////////////////////
+static void loadSettings()
+{
+    // the routing has been saved since the journaled store only
+    initRouting();
+    STORE_Load(STORE_ROUTES, routing.raw, sizeof(routing_t)/2);
+    memcpy(targets.map, defaultTargets, sizeof(targets.map));
+    STORE_Load(STORE_TARGETS, targets.raw, sizeof(targets_t)/2);
+
+    // fields which are not stored yet keep their default value
+    initSettings();
+
+    if (STORE_Load(STORE_SETTINGS, settings.raw, sizeof(settings_t)/2) >= 0)
+        return;
+
+    int i;
+    for (i = 0; i < SETTINGS_LEGACY_MAX_WORDS; i++)
+    {
+        int32_t result = EEPROM_Read(i);
+        if (result >= 0)
+            settings.raw[i] = result;
+        else if ((result == -1) && (i >= SETTINGS_LEGACY_WORDS))
+            break;
+        else
         {
-            // soon switching off the scene
-            if ((queuedScene == 0) && (currentScene > 0))
-            {
-                MIOS32_DOUT_PinSet(currentScene - 1, FAST_BLINK?1:0);
-            }
-            else if (queuedScene > 0)
-            {
-                MIOS32_DOUT_PinSet(queuedScene - 1, FAST_BLINK?1:0);
-            }
+            if (result == -1)
+                MIOS32_MIDI_SendDebugMessage("Error reading settings at address %d: Page not programmed yet.", i);
+            else if (result == -2)
+                MIOS32_MIDI_SendDebugMessage("Error reading settings at address %d: Page not found.", i);
+            else
+                MIOS32_MIDI_SendDebugMessage("Error reading settings at address %d: Unknown error %d.", i, result);
+            initSettings();
+            break;
         }
     }
+}
 
-    // turn on the led for the kill state
-    MIOS32_DOUT_PinSet(LED_KILL, performanceKill?1:0);
-    // if there's a kill state change queued - display that
-    if (queuedPerformanceKillState != performanceKill)
-        MIOS32_DOUT_PinSet(LED_KILL, FAST_BLINK?1:0);
+static void initSettings()
+{
+    settings.readable.sync = 1;
+    settings.readable.syncSource = syncToMidi1;
+    settings.readable.syncNominator = 8;
+    settings.readable.syncDenominator = _1_8;
+    settings.readable.muteMode = 1;
+    settings.readable.killEnable = 0x0fff;
+    settings.readable.syncLead = 0;
+    settings.readable.clockRegen = 0;
+    settings.readable.rampShape = rampLinear;
+    settings.readable.rampLength = 0;
+    settings.readable.reserved = 0;
+    settings.readable.masterBpm = 1200;
+}
 
-    // set the sync led
-    if (settings.readable.sync)
+static void initRouting()
+{
+    memcpy(routing.filter, defaultRouting, sizeof(routing.filter));
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// compiles the routing matrix. MIDI 1 Out only gets the THRU of MIDI 1 In
+// or of the Rytm if that is the sync source.
+/////////////////////////////////////////////////////////////////////////////
+static void compileRoutes()
+{
+    routeFilter_t filter[ROUTE_NUM_PORTS][ROUTE_NUM_PORTS];
+    memcpy(filter, routing.filter, sizeof(filter));
+    if (settings.readable.syncSource != syncToMidi1)
+        filter[1][1].types = 0;
+    if (settings.readable.syncSource != syncToRytm)
+        filter[2][1].types = 0;
+    ROUTE_Compile(filter);
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// returns the port of a target, 0 if it is off
+/////////////////////////////////////////////////////////////////////////////
+static mios32_midi_port_t targetPort(int t)
+{
+    static const mios32_midi_port_t port[] = { 0, USB0, UART0, UART1 };
+    return port[targets.map[t].port & 3];
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// returns the target shown on the LEDs, the first of the selected ones
+/////////////////////////////////////////////////////////////////////////////
+static int shownTarget()
+{
+    int t;
+    for (t = 0; t < TARGET_NUM; t++)
+        if (selectedTargets & (1 << t))
+            return t;
+    return 0;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// returns true if the buttons change the target: it is selected and on
+/////////////////////////////////////////////////////////////////////////////
+static bool isEdited(int t)
+{
+    return (selectedTargets & (1 << t)) && targetPort(t);
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// the buttons change all targets, then each of the targets which are on in
+// turn
+/////////////////////////////////////////////////////////////////////////////
+static void selectNextTargets()
+{
+    u8 all = (1 << TARGET_NUM) - 1;
+    int t = (selectedTargets == all) ? 0 : shownTarget() + 1;
+    for (; t < TARGET_NUM; t++)
     {
-        // when synced: led is on, briefly flashes of on the sync point
-        // if no tempo signal is present, flash continuously
-        if ((syncCounter == 0) && (syncFlashPulseCounter == 0))
-            syncFlashPulseCounter = FLASH_PULSE;
-        if (syncFlashPulseCounter)
-            syncFlashPulseCounter--;
-        MIOS32_DOUT_PinSet(LED_SYNC, (syncFlashPulseCounter > FLASH_PULSE/2)?0:1);
+        if (targetPort(t))
+        {
+            selectedTargets = 1 << t;
+            return;
+        }
     }
-    else
-        MIOS32_DOUT_PinSet(LED_SYNC, 0);
+    selectedTargets = all;
 }
 
-static void displaySettings()
+/////////////////////////////////////////////////////////////////////////////
+// takes over the mapping of a target received by SysEx and saves it
+/////////////////////////////////////////////////////////////////////////////
+static void loadTargetMap()
 {
-    if (showSettings == showKillEnable)
+    u8 length;
+    const u8 *data = SYSEX_DataGet(&length);
+    targetMap_t map;
+    if ((length != 1 + sizeof(targetMap_t)) || (data[0] >= TARGET_NUM))
     {
-        MIOS32_DOUT_PinSet(LED_KILL, SLOW_BLINK?1:0);
-        MIOS32_DOUT_PinSet(LED_SYNC, 1);
-        MIOS32_DOUT_PinSet(LED_MUTEMODE, 0);
-
-        int i;
-        for (i = 0; i < 12; i++)
-            MIOS32_DOUT_PinSet(i, (settings.readable.killEnable & (1 << i))?1:0);
+        MIOS32_MIDI_SendDebugMessage("Invalid target map: %d bytes", length);
+        return;
     }
-    else
+    memcpy(&map, &data[1], sizeof(targetMap_t));
+    // the 12 tracks have to fit on the channels
+    if ((map.port > targetMidi2) || (map.channel > Chn16) || (map.potChannel > Chn16) || (map.trackChannel > Chn16 - 11))
     {
-        MIOS32_DOUT_PinSet(LED_KILL, settings.readable.syncSource == syncToMidi1);
-        MIOS32_DOUT_PinSet(LED_SYNC, 1);
-        MIOS32_DOUT_PinSet(LED_MUTEMODE, SLOW_BLINK?1:0);
-
-        int i;
-        for (i = 0; i < 4; i++)
-            MIOS32_DOUT_PinSet(i, (settings.readable.syncDenominator & (1 << i))?1:0);
-        for (i = 4; i < 12; i++)
-            MIOS32_DOUT_PinSet(i, (settings.readable.syncNominator == i)?1:0);
+        MIOS32_MIDI_SendDebugMessage("Invalid target map: port or channel out of range");
+        return;
     }
+
+    targets.map[data[0]] = map;
+    storeSettings();
+    MIOS32_MIDI_SendDebugMessage("Target %d: port %d, channel %d, pots on channel %d, tracks from channel %d",
+                                 data[0] + 1, map.port, map.channel + 1, map.potChannel + 1, map.trackChannel + 1);
 }
 
-static void storeSettings()
+/////////////////////////////////////////////////////////////////////////////
+// sends the mapping of a target in the format it is loaded in
+/////////////////////////////////////////////////////////////////////////////
+static void sendTargetMap()
 {
-    int i;
-    for (i = 0; i < sizeof(settings_t)/2; i++)
-    {
-        int32_t result = EEPROM_Write(i, settings.raw[i]);
-
-        if (result == -1)
-            MIOS32_MIDI_SendDebugMessage("Error writing settings at address %d: Page is full.", i);
-        else if (result == -2)
-            MIOS32_MIDI_SendDebugMessage("Error writing settings at address %d: No valid page was found.", i);
-        else if (result == -3)
-            MIOS32_MIDI_SendDebugMessage("Error writing settings at address %d: Flash write error.", i);
-        else if (result < 0)
-            MIOS32_MIDI_SendDebugMessage("Error writing settings at address %d: Unknown error %d.", i, result);
-        if (result < 0)
-            break;
-    }
+    u8 length;
+    const u8 *data = SYSEX_DataGet(&length);
+    if ((length != 1) || (data[0] >= TARGET_NUM))
+        return;
+
+    u8 message[7 + sizeof(targetMap_t)];
+    u8 *m = message;
+    *m++ = 0xf0;
+    *m++ = SYSEX_ID;
+    *m++ = SYSEX_ID_1;
+    *m++ = SYSEX_ID_2;
+    *m++ = SYSEX_TARGET_MAP;
+    *m++ = data[0];
+    memcpy(m, &targets.map[data[0]], sizeof(targetMap_t));
+    m += sizeof(targetMap_t);
+    *m++ = 0xf7;
+    MIOS32_MIDI_SendSysEx(USB0, message, m - message);
 }
 
-static void loadSettings()
+/////////////////////////////////////////////////////////////////////////////
+// takes over a route of the matrix received by SysEx, recompiles the
+// matrix and saves it
+/////////////////////////////////////////////////////////////////////////////
+static void loadRoute()
 {
-    int i;
-    for (i = 0; i < sizeof(settings_t)/2; i++)
+    u8 length;
+    const u8 *data = SYSEX_DataGet(&length);
+    if ((length != 10) || (data[0] >= ROUTE_NUM_PORTS) || (data[1] >= ROUTE_NUM_PORTS))
     {
-        int32_t result = EEPROM_Read(i);
-        if (result >= 0)
-            settings.raw[i] = result;
-        else
-        {
-            if (result == -1)
-                MIOS32_MIDI_SendDebugMessage("Error reading settings at address %d: Page not programmed yet.", i);
-            else if (result == -2)
-                MIOS32_MIDI_SendDebugMessage("Error reading settings at address %d: Page not found.", i);
-            else
-                MIOS32_MIDI_SendDebugMessage("Error reading settings at address %d: Unknown error %d.", i, result);
-            initSettings();
-            break;
-        }
+        MIOS32_MIDI_SendDebugMessage("Invalid route: %d bytes", length);
+        return;
+    }
+    routeFilter_t filter;
+    filter.types = (data[2] << 14) | (data[3] << 7) | data[4];
+    filter.channels = (data[5] << 14) | (data[6] << 7) | data[7];
+    filter.ccFirst = data[8];
+    filter.ccLast = data[9];
+    if ((data[2] > 3) || (data[5] > 3) || (filter.ccFirst > filter.ccLast))
+    {
+        MIOS32_MIDI_SendDebugMessage("Invalid route: flags or CC range out of range");
+        return;
     }
+
+    routing.filter[data[0]][data[1]] = filter;
+    compileRoutes();
+    storeSettings();
+    MIOS32_MIDI_SendDebugMessage("Route %d -> %d: types %04x, channels %04x, CCs %d..%d",
+                                 data[0], data[1], filter.types, filter.channels, filter.ccFirst, filter.ccLast);
 }
 
-static void initSettings()
+/////////////////////////////////////////////////////////////////////////////
+// sends a route of the matrix in the format it is loaded in
+/////////////////////////////////////////////////////////////////////////////
+static void sendRoute()
 {
-    settings.readable.sync = 1;
-    settings.readable.syncSource = syncToMidi1;
-    settings.readable.syncNominator = 8;
-    settings.readable.syncDenominator = _1_8;
-    settings.readable.muteMode = 1;
-    settings.readable.killEnable = 0x0fff;
+    u8 length;
+    const u8 *data = SYSEX_DataGet(&length);
+    if ((length != 2) || (data[0] >= ROUTE_NUM_PORTS) || (data[1] >= ROUTE_NUM_PORTS))
+        return;
+
+    const routeFilter_t *filter = &routing.filter[data[0]][data[1]];
+    u8 message[16];
+    u8 *m = message;
+    *m++ = 0xf0;
+    *m++ = SYSEX_ID;
+    *m++ = SYSEX_ID_1;
+    *m++ = SYSEX_ID_2;
+    *m++ = SYSEX_ROUTE;
+    *m++ = data[0];
+    *m++ = data[1];
+    *m++ = filter->types >> 14;
+    *m++ = (filter->types >> 7) & 0x7f;
+    *m++ = filter->types & 0x7f;
+    *m++ = filter->channels >> 14;
+    *m++ = (filter->channels >> 7) & 0x7f;
+    *m++ = filter->channels & 0x7f;
+    *m++ = filter->ccFirst;
+    *m++ = filter->ccLast;
+    *m++ = 0xf7;
+    MIOS32_MIDI_SendSysEx(USB0, message, m - message);
 }
 
 static void checkEnterSettings()
@@ -360,8 +1789,14 @@ static void checkEnterSettings()
             case showKillEnable:
                 showSettings = showSyncOptions;
                 break;
-            default:
             case showSyncOptions:
+                showSettings = showLatencyOptions;
+                break;
+            case showLatencyOptions:
+                showSettings = showRampOptions;
+                break;
+            default:
+            case showRampOptions:
                 storeSettings();
                 showSettings = dontShowSettings;
                 break;
@@ -374,45 +1809,121 @@ static void checkEnterSettings()
 /////////////////////////////////////////////////////////////////////////////
 void APP_Init(void)
 {
+    // the state mutex is used by all hooks
+    xStateSemaphore = xSemaphoreCreateRecursiveMutex();
+
     // init all onboard LEDs
     MIOS32_BOARD_LED_Init(0xffffffff);
     // init the eeprom
     EEPROM_Init(0);
+    // init the uS time base
+    TIMEBASE_Init();
+    // the hooks are measured with the same cycle counter
+    PROFILE_Init();
+    profileReportRequested = 0;
+    SYSEX_Init();
+    heldSysEx.ALL = 0;
+    // the trace records from here on
+    TRACE_Init();
+    traceDumpRequested = 0;
+    // a panel on the computer can subscribe to the state
+    STATE_SYNC_Init(USB0);
+    publishedBpm = 0;
+    // init the output stage for the Rytm
+    MIDI_OUT_Init();
 
     // init variables
+    int i;
     performanceKill = 0;
     queuedPerformanceKillState = 0;
-    currentScene = 0;
-    queuedScene = -1;
-    currentTrackMutes = 0;
-    queuedTrackMutes = 0;
+    queuedMacros = 0;
+    for (i = 0; i < TARGET_NUM; i++)
+    {
+        target[i].currentScene = 0;
+        target[i].queuedScene = -1;
+        target[i].currentTrackMutes = 0;
+        target[i].queuedTrackMutes = 0;
+    }
+    selectedTargets = (1 << TARGET_NUM) - 1;
 
     runMode = stopped;
     syncCounter = 0;
-    runTestSyncCounter = 0;
-    syncTimeout = 0;
+    songPosition = 0;
+    lastSyncEventTime = 0;
+    tempoReported = 0;
+    TEMPO_Init();
+    predictedSyncTime = 0;
+    preDispatchArmed = 0;
+    preDispatchActions = 0;
+    SCHED_Init();
+    for (i = 0; i < NUM_ACTIONS; i++)
+        actionEvent[i] = -1;
 
     blinkCounter = 0;
     syncFlashPulseCounter = 0;
+    memset(&ledInputs, 0xff, sizeof(ledInputs_t)); // forces the first update
+    memset((void *)ledPlanes, 0, sizeof(ledPlanes));
+    ledBamSlot = 0;
+    ledFrame = 0;
     showSettings = dontShowSettings;
     muteBttnState = 1;
     syncBttnState = 1;
+    killBttnState = 1;
     ignoreNextSyncBttnRelease = 0;
     ignoreNextMuteBttnRelease = 0;
 
-    int i;
-    for (i = POT_FIRST; i < POT_FIRST + 12; i++)
+    // start the pot filter at the current positions. Nothing is sent, the
+    // pots take over once they are moved.
+    POTS_Init();
+    for (i = 0; i < POTS_NUM; i++)
     {
-        APP_AIN_NotifyChange(i, MIOS32_AIN_PinGet(i));
+        lastValue[i] = POTS_ValueGet(i);
+        macroValue[i] = MACRO_UNKNOWN;
     }
+    potPickedUp = 0;
+    potAboveMacro = 0;
+    RAMP_Init();
+
+    // the motion recorder starts with the current pot positions
+    MOTION_Init();
+    for (i = 0; i < 12; i++)
+        motionValues[i] = playedValues[i] = lastValue[i] >> 7;
+    motionState = motionIdle;
+    motionPlayed = 0;
+    motionOrigin = 0;
+
+    // the snapshots are stored in the BankStick
+    if (SNAPSHOT_Init() < 0)
+        MIOS32_MIDI_SendDebugMessage("No BankStick found, the snapshots are not available.");
+
+    loadSettings();
+    compileRoutes();
 
     // init current scene
-    MIOS32_MIDI_SendCC(UART1, Chn1, SCENE_CC, sceneCCValue[currentScene]);
+    for (i = 0; i < TARGET_NUM; i++)
+        if (targetPort(i))
+            MIDI_OUT_SendCC(targetPort(i), targets.map[i].channel, targets.map[i].sceneCC, sceneCCValue[target[i].currentScene]);
+
+    // the settings dump of the Rytm tells the track mutes and the scene
+    RYTM_DUMP_Init();
+    dumpRequestsLeft = DUMP_REQUESTS;
+    requestRytmState();
+
+    // start the re-clocked clock output
+    CLOCK_OUT_Init();
+    updateClockOut();
+
+    // the master clock only runs if it is the sync source
+    MASTER_CLOCK_Init();
+    MASTER_CLOCK_BpmSet(settings.readable.masterBpm);
+    MASTER_CLOCK_Enable(settings.readable.syncSource == syncToInternal);
+
+    // start the task which runs the sync logic
+    MIDI_IN_Init();
+    xTaskCreate(TASK_Sync, (signed portCHAR *)"Sync", configMINIMAL_STACK_SIZE, NULL, PRIORITY_TASK_SYNC, NULL);
 
     // install MIDI Rx callback function
     MIOS32_MIDI_DirectRxCallback_Init(NOTIFY_MIDI_Rx);
-
-    loadSettings();
 }
 
 
@@ -421,6 +1932,22 @@ void APP_Init(void)
 /////////////////////////////////////////////////////////////////////////////
 void APP_Background(void)
 {
+    if (profileReportRequested)
+    {
+        profileReportRequested = 0;
+        PROFILE_Report();
+    }
+    if (traceDumpRequested)
+    {
+        traceDumpRequested = 0;
+        TRACE_Dump(USB0);
+    }
+
+    // the stored snapshots are written to the BankStick outside of the
+    // state mutex
+    s32 failedSlot = SNAPSHOT_Background();
+    if (failedSlot > 0)
+        MIOS32_MIDI_SendDebugMessage("Error writing snapshot %d to the BankStick.", failedSlot);
 }
 
 
@@ -433,33 +1960,47 @@ void APP_Background(void)
 /////////////////////////////////////////////////////////////////////////////
 void APP_Tick(void)
 {
-    // check if the sync counter still advances (clock signal is present)
-    if ((runMode == running) && (runTestSyncCounter == syncCounter))
-    {
-        syncTimeout++;
-    }
-    else
-    {
-        runTestSyncCounter = syncCounter;
-        syncTimeout = 0;
-    }
-    // on timeout: reset to stopped mode
-    if (syncTimeout >= SYNC_TIMEOUT)
+    u32 profileBegin = PROFILE_Begin();
+    MUTEX_STATE_TAKE;
+
+    // on timeout (no clock signal for a few expected ticks): reset to stopped mode
+    if ((runMode == running) && ((TIMEBASE_Get() - lastSyncEventTime) > TEMPO_TimeoutGet()))
     {
         runMode = stopped;
         syncCounter = 0;
-        runTestSyncCounter = 0;
-        syncTimeout = 0;
+        preDispatchArmed = 0;
+        TEMPO_Init();
+        tempoReported = 0;
+        sendRampValues(RAMP_Finish());
     }
 
+    // repeat the request for the state of the Rytm until it answers
+    if (dumpRequestsLeft && (--dumpRequestTimer == 0))
+        requestRytmState();
+
+    u32 potsBegin = PROFILE_Begin();
+    updatePots();
+    PROFILE_End(profilePots, potsBegin);
+    MIDI_OUT_Tick();
+
     blinkCounter++;
     if (blinkCounter > BLINK_MAX)
         blinkCounter = 0;
 
-    if (showSettings)
-        displaySettings();
-    else
-        updateLEDs();
+    // the sync led flashes on the sync points
+    if (settings.readable.sync && !showSettings)
+    {
+        if ((syncCounter == 0) && (syncFlashPulseCounter == 0))
+            syncFlashPulseCounter = FLASH_PULSE;
+        if (syncFlashPulseCounter)
+            syncFlashPulseCounter--;
+    }
+
+    updateLEDs();
+    publishState();
+
+    MUTEX_STATE_GIVE;
+    PROFILE_End(profileTick, profileBegin);
 }
 
 
@@ -470,6 +2011,7 @@ void APP_Tick(void)
 /////////////////////////////////////////////////////////////////////////////
 void APP_MIDI_Tick(void)
 {
+    MIDI_OUT_Tick();
 }
 
 
@@ -482,7 +2024,8 @@ void APP_MIDI_NotifyPackage(mios32_midi_port_t port, mios32_midi_package_t midi_
     /*
     MIDI 1 In:  Data from here will be forwarded to the Rytm.
     MIDI 1 Out: If clocked externally, this is a MIDI THRU for MIDI 1 In.
-                If clocked from the Rytm, this is the THRU for MIDI 2 In.
+                If clocked from the Rytm, this is the THRU for MIDI 2 In
+                (by default only the clock and the transport).
     MIDI 2 In:  Connect this to the Rytms MIDI Out for feedback over
                 over the track mute states (and for syncing to the
                 Rytms clock output, if that is the selected sync
@@ -490,62 +2033,139 @@ void APP_MIDI_NotifyPackage(mios32_midi_port_t port, mios32_midi_package_t midi_
     MIDI 2 Out: Connect this to the Rytms MIDI Input
     */
 
-    // forward incoming messages.
-    switch( port ) {
-        case USB0:
-            MIOS32_MIDI_SendPackage(UART0, midi_package);
-            MIOS32_MIDI_SendPackage(UART1, midi_package);
-            break;
-        case UART0:
-            MIOS32_MIDI_SendPackage(USB0,  midi_package);
-            MIOS32_MIDI_SendPackage(UART1, midi_package);
+    u32 profileBegin = PROFILE_Begin();
+    MUTEX_STATE_TAKE;
 
-            if (settings.readable.syncSource == syncToMidi1)
-                MIOS32_MIDI_SendPackage(UART0, midi_package);
-            break;
-        case UART1:
+    // commands of the controller are executed, not forwarded. The first
+    // package of a SysEx is held back until the header is complete.
+    s32 command = -1;
+    if (port == USB0)
+    {
+        command = SYSEX_Parse(midi_package);
+        u8 owner = SYSEX_Owner();
+        bool isRealtime = (midi_package.type == 0xf) && (midi_package.evnt0 >= 0xF8);
+        if ((owner == SYSEX_NONE) && heldSysEx.ALL && !isRealtime)
+            forwardPackage(port, heldSysEx);
+        if (!isRealtime)
+            heldSysEx.ALL = (owner == SYSEX_MAYBE) ? midi_package.ALL : 0;
+        if (owner == SYSEX_NONE)
+            forwardPackage(port, midi_package);
+        else if (owner == SYSEX_IGNORED)
+            MIOS32_MIDI_SendDebugMessage("SysEx command too long, ignored.");
+    }
+    else
+        forwardPackage(port, midi_package);
+
+    // feedback of the Rytm
+    if (port == UART1)
+    {
+        if (RYTM_DUMP_Parse(midi_package) > 0)
+            mirrorRytmState();
+        if (midi_package.event == CC)
+        {
+            macroChanged(UART1, midi_package);
+            // the targets on MIDI 2 Out
+            int t;
+            for (t = 0; t < TARGET_NUM; t++)
             {
-                if (settings.readable.syncSource == syncToRytm)
-                    MIOS32_MIDI_SendPackage(UART0, midi_package);
-                if (midi_package.event == CC)
+                if (targetPort(t) != UART1)
+                    continue;
+                targetState_t *s = &target[t];
+                const targetMap_t *map = &targets.map[t];
+                int track = midi_package.chn - map->trackChannel;
+                if (midi_package.value1 == map->muteCC)
                 {
-                    if (midi_package.value1 == MUTE_CC)
+                    if ((track >= 0) && (track < 12))
                     {
-                        if (midi_package.chn <= Chn12)
+                        if (midi_package.value2 > 0)
                         {
-                            if (midi_package.value2 > 0)
-                            {
-                                currentTrackMutes |= (1 << midi_package.chn);
-                                queuedTrackMutes |= (1 << midi_package.chn);
-                            }
-                            else
-                            {
-                                currentTrackMutes &= ~(1 << midi_package.chn);
-                                queuedTrackMutes &= ~(1 << midi_package.chn);
-                            }
+                            s->currentTrackMutes |= (1 << track);
+                            s->queuedTrackMutes |= (1 << track);
                         }
-                    }
-                    else if (midi_package.value1 == SCENE_CC)
-                    {
-                        int sceneNumber;
-                        for (sceneNumber = 0; sceneNumber < 12; sceneNumber++)
+                        else
                         {
-                            if (midi_package.value2 <= sceneCCValue[sceneNumber])
-                                break;
+                            s->currentTrackMutes &= ~(1 << track);
+                            s->queuedTrackMutes &= ~(1 << track);
                         }
-                        currentScene = sceneNumber;
                     }
                 }
-            } break;
+                else if (midi_package.value1 == map->sceneCC)
+                {
+                    int sceneNumber;
+                    for (sceneNumber = 0; sceneNumber < 12; sceneNumber++)
+                    {
+                        if (midi_package.value2 <= sceneCCValue[sceneNumber])
+                            break;
+                    }
+                    s->currentScene = sceneNumber;
+                }
+            }
+        }
+    }
+
+    handleSysExCommand(command);
+
+    MIDI_OUT_Flush();
+
+    MUTEX_STATE_GIVE;
+    PROFILE_End(profileMidiPackage, profileBegin);
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// executes a SysEx command received on USB0
+/////////////////////////////////////////////////////////////////////////////
+static void handleSysExCommand(s32 command)
+{
+    switch (command)
+    {
+        case SYSEX_PROFILE_REPORT:
+            profileReportRequested = 1;
+            break;
+        case SYSEX_PROFILE_RESET:
+            PROFILE_Init();
+            MIOS32_MIDI_SendDebugMessage("Profiler results cleared");
+            break;
+        case SYSEX_TRACE_DUMP:
+            traceDumpRequested = 1;
+            break;
+        case SYSEX_STATE_REQUEST:
+            STATE_SYNC_Request();
+            break;
+        case SYSEX_STATE_STOP:
+            STATE_SYNC_Stop();
+            break;
+        case SYSEX_TARGET_MAP:
+            loadTargetMap();
+            break;
+        case SYSEX_TARGET_REQUEST:
+            sendTargetMap();
+            break;
+        case SYSEX_ROUTE:
+            loadRoute();
+            break;
+        case SYSEX_ROUTE_REQUEST:
+            sendRoute();
+            break;
     }
 }
 
 
 /////////////////////////////////////////////////////////////////////////////
 // This hook is called before the shift register chain is scanned
+// It shows the next bit plane of the LED brightness
 /////////////////////////////////////////////////////////////////////////////
 void APP_SRIO_ServicePrepare(void)
 {
+    u16 frame = ledPlanes[ledBamPlane[ledBamSlot]];
+    if (++ledBamSlot >= LED_BAM_SLOTS)
+        ledBamSlot = 0;
+
+    u16 changed = frame ^ ledFrame;
+    if (changed & 0x00ff)
+        MIOS32_DOUT_SRSet(LED_SR_FIRST, frame & 0xff);
+    if (changed & 0xff00)
+        MIOS32_DOUT_SRSet(LED_SR_FIRST + 1, frame >> 8);
+    ledFrame = frame;
 }
 
 
@@ -567,12 +2187,39 @@ void APP_DIN_NotifyToggle(u32 pin, u32 pin_value)
     //MIOS32_MIDI_SendDebugMessage("Digital pin: %d = %d", pin, pin_value);
     //MIOS32_DOUT_PinSet(pin, (pin_value == 0)? 1:0);
 
+    u32 profileBegin = PROFILE_Begin();
+    TRACE_Record(TRACE_BUTTON, pin | (pin_value << 8));
+    MUTEX_STATE_TAKE;
+    handleButton(pin, pin_value);
+    MIDI_OUT_Flush();
+    MUTEX_STATE_GIVE;
+    PROFILE_End(profileDin, profileBegin);
+}
+
+static void handleButton(u32 pin, u32 pin_value)
+{
     if ((pin >= SWITCH_FIRST) && (pin < SWITCH_FIRST + 12))
     {
         if (pin_value)
             return;
 
-        if (showSettings == showKillEnable)
+        if (!syncBttnState && (settings.readable.syncSource == syncToInternal) && (showSettings == dontShowSettings))
+        {
+            // Sync is held: the buttons control the master clock
+            handleMasterClockButton(pin - SWITCH_FIRST);
+            ignoreNextSyncBttnRelease = 1;
+        }
+        else if (!muteBttnState && (showSettings == dontShowSettings))
+        {
+            // Mute/Scene is held: recall a snapshot, with Kill held as well
+            // store one
+            if (!killBttnState)
+                storeSnapshot(pin - SWITCH_FIRST);
+            else
+                recallSnapshot(pin - SWITCH_FIRST);
+            ignoreNextMuteBttnRelease = 1;
+        }
+        else if (showSettings == showKillEnable)
         {
             int i = pin - SWITCH_FIRST;
             settings.readable.killEnable ^= (1 << i);
@@ -584,45 +2231,113 @@ void APP_DIN_NotifyToggle(u32 pin, u32 pin_value)
                 settings.readable.syncDenominator = 1 << i;
             else
                 settings.readable.syncNominator = i;
+            // keep the sync points on the bar lines of the new cycle
+            syncToSongPosition();
+        }
+        else if (showSettings == showLatencyOptions)
+        {
+            int lead = pin - SWITCH_FIRST + 1;
+            // selecting the current lead time again switches the pre-dispatch off
+            settings.readable.syncLead = (settings.readable.syncLead == lead) ? 0 : lead;
+        }
+        else if (showSettings == showRampOptions)
+        {
+            int length = pin - SWITCH_FIRST + 1;
+            // selecting the current length again switches the ramps off
+            settings.readable.rampLength = (settings.readable.rampLength == length) ? 0 : length;
         }
         else if (settings.readable.muteMode)
         {
-            bool isMuted = (queuedTrackMutes & (1 << pin))?1:0;
-            if (isMuted)
-                queuedTrackMutes &= ~(1 << pin);
-            else
-                queuedTrackMutes |= (1 << pin);
+            int t;
+            for (t = 0; t < TARGET_NUM; t++)
+                if (isEdited(t))
+                    target[t].queuedTrackMutes ^= (1 << pin);
 
             if (!settings.readable.sync || runMode == stopped)
                 triggerMuteSync();
+            else
+                scheduleAction(actionMutes);
         }
         else
         {
             int newScene = pin - SWITCH_FIRST + 1;
-            if (newScene == queuedScene) // there's something queued - abort
-                queuedScene = -1;
-            else if (newScene == currentScene) // switch off scene
-                queuedScene = 0;
-            else
-                queuedScene = newScene;
+            int t;
+            for (t = 0; t < TARGET_NUM; t++)
+            {
+                if (!isEdited(t))
+                    continue;
+                targetState_t *s = &target[t];
+                if (newScene == s->queuedScene) // there's something queued - abort
+                    s->queuedScene = -1;
+                else if (newScene == s->currentScene) // switch off scene
+                    s->queuedScene = 0;
+                else
+                    s->queuedScene = newScene;
+            }
 
             if (!settings.readable.sync || runMode == stopped)
                 triggerSceneSync();
+            else
+                scheduleAction(actionScene);
         }
     }
     else if (pin == SWITCH_KILL)
     {
+        killBttnState = pin_value;
         if (pin_value)
             return;
 
-        if (showSettings == showSyncOptions)
+        if (showSettings == showKillEnable)
+        {
+            selectNextTargets();
+        }
+        else if (showSettings == showSyncOptions)
         {
-            settings.readable.syncSource = (settings.readable.syncSource == syncToMidi1)?syncToRytm:syncToMidi1;
+            if (settings.readable.syncSource == syncToMidi1)
+                settings.readable.syncSource = syncToRytm;
+            else if (settings.readable.syncSource == syncToRytm)
+                settings.readable.syncSource = syncToInternal;
+            else
+                settings.readable.syncSource = syncToMidi1;
+            MASTER_CLOCK_Enable(settings.readable.syncSource == syncToInternal);
+            runMode = stopped;
+            sendRampValues(RAMP_Finish());
             triggerKillSync();
             triggerSceneSync();
             triggerMuteSync();
+            triggerMacroSync();
             syncCounter = 0;
-            runMode = stopped;
+            songPosition = 0;
+            preDispatchArmed = 0;
+            TEMPO_Init();
+            tempoReported = 0;
+            updateClockOut();
+            compileRoutes();
+        }
+        else if (showSettings == showLatencyOptions)
+        {
+            settings.readable.clockRegen = !settings.readable.clockRegen;
+            updateClockOut();
+        }
+        else if (showSettings == showRampOptions)
+        {
+            if (settings.readable.rampShape == rampLinear)
+                settings.readable.rampShape = rampCurved;
+            else if (settings.readable.rampShape == rampCurved)
+                settings.readable.rampShape = rampSCurve;
+            else
+                settings.readable.rampShape = rampLinear;
+        }
+        else if (!syncBttnState && (showSettings == dontShowSettings))
+        {
+            // Sync + Kill: motion recorder
+            handleMotionButton();
+            ignoreNextSyncBttnRelease = 1;
+        }
+        else if (!muteBttnState && (showSettings == dontShowSettings))
+        {
+            // Mute/Scene + Kill + button: store a snapshot
+            ignoreNextMuteBttnRelease = 1;
         }
         else if (showSettings == dontShowSettings)
         {
@@ -630,6 +2345,8 @@ void APP_DIN_NotifyToggle(u32 pin, u32 pin_value)
 
             if (!settings.readable.sync || runMode == stopped)
                 triggerKillSync();
+            else
+                scheduleAction(actionKill);
         }
     }
     else if (pin == SWITCH_SYNC)
@@ -650,6 +2367,7 @@ void APP_DIN_NotifyToggle(u32 pin, u32 pin_value)
         triggerKillSync();
         triggerSceneSync();
         triggerMuteSync();
+        triggerMacroSync();
     }
     else if (pin == SWITCH_MUTEMODE)
     {
@@ -682,70 +2400,235 @@ void APP_ENC_NotifyChange(u32 encoder, s32 incrementer)
 
 /////////////////////////////////////////////////////////////////////////////
 // This hook is called when a pot has been moved
+// The pots are sampled and filtered in APP_Tick instead (see pots.c)
 /////////////////////////////////////////////////////////////////////////////
 void APP_AIN_NotifyChange(u32 pin, u32 pin_value)
 {
-    // convert 12bit value to 7bit value
-    u8 value_7bit = pin_value >> 5;
-    //MIOS32_MIDI_SendDebugMessage("Analog pin: %d = %d", pin, pin_value);
-
-    if ((pin >= POT_FIRST) && (pin < POT_FIRST + 12))
-    {
-        lastValue[pin - POT_FIRST] = value_7bit;
-        if (!(performanceKill && (settings.readable.killEnable & (1 << (pin - POT_FIRST)))))
-            MIOS32_MIDI_SendCC(UART1, Chn15, potCC[pin - POT_FIRST], value_7bit);
-    }
 }
 
 /////////////////////////////////////////////////////////////////////////////
 // Installed via MIOS32_MIDI_DirectRxCallback_Init
+// Called from the UART receive interrupt for each byte, so it only queues
+// the realtime messages and song position pointers of the selected sync
+// source for the sync task.
 /////////////////////////////////////////////////////////////////////////////
 static s32 NOTIFY_MIDI_Rx(mios32_midi_port_t port, u8 midi_byte)
 {
-    if (   ((port == UART0) && (settings.readable.syncSource == syncToMidi1))
+    u32 profileBegin = PROFILE_Begin();
+    TRACE_MidiIn(port, midi_byte);
+    s32 status = handleMidiRx(port, midi_byte);
+    PROFILE_End(profileMidiRx, profileBegin);
+    return status;
+}
+
+static s32 handleMidiRx(mios32_midi_port_t port, u8 midi_byte)
+{
+    if (!isSyncSource(port))
+        return 0;
+
+    // realtime messages can be placed between the data bytes of other
+    // messages, they don't affect the parser
+    if (midi_byte >= 0xF8)
+    {
+        if (midi_byte <= 0xFC)
+            MIDI_IN_Push(midi_byte, 0, TIMEBASE_Get());
+        return 0;
+    }
+
+    sppParser_t *spp = &sppParser[(port == USB0) ? 0 : (port == UART0) ? 1 : 2];
+    if (midi_byte & 0x80)
+        spp->pending = (midi_byte == 0xF2) ? 2 : 0;
+    else if (spp->pending == 2)
+    {
+        spp->lsb = midi_byte;
+        spp->pending = 1;
+    }
+    else if (spp->pending == 1)
+    {
+        MIDI_IN_Push(0xF2, spp->lsb | (midi_byte << 7), TIMEBASE_Get());
+        spp->pending = 0;
+    }
+    return 0; // no error, no filtering
+}
+
+static bool isSyncSource(mios32_midi_port_t port)
+{
+    return ((port == UART0) && (settings.readable.syncSource == syncToMidi1))
         || ((port == USB0)  && (settings.readable.syncSource == syncToMidi1))
-        || ((port == UART1) && (settings.readable.syncSource == syncToRytm )) )
+        || ((port == UART1) && (settings.readable.syncSource == syncToRytm ));
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// forwards a received package, as far as the routing matrix lets it pass
+/////////////////////////////////////////////////////////////////////////////
+static void forwardPackage(mios32_midi_port_t port, mios32_midi_package_t package)
+{
+    u8 destinations = ROUTE_Destinations(port, package);
+    if ((destinations & ROUTE_USB0) && !isRegenerated(port, USB0, package))
     {
-        int syncMax = settings.readable.syncNominator * settings.readable.syncDenominator * 6;
-        switch (midi_byte)
-        {
-            case 0xF8: // clock
-                {
-                    if (runMode == running)
-                    {
-                        syncCounter++;
-                        if (syncCounter >= syncMax)
-                        {
-                            triggerKillSync();
-                            triggerSceneSync();
-                            triggerMuteSync();
-                            syncCounter = 0;
-                        }
-                    }
-                } break;
-            case 0xFA: // start
-                {
-                    runMode = running;
-                    syncCounter = 0;
-                    triggerKillSync();
-                    triggerSceneSync();
-                    triggerMuteSync();
-                } break;
-            case 0xFB: // continue
+        MIDI_OUT_SendPackage(USB0, package);
+        macroChanged(USB0, package);
+    }
+    if ((destinations & ROUTE_UART0) && !isRegenerated(port, UART0, package))
+    {
+        MIDI_OUT_SendPackage(UART0, package);
+        macroChanged(UART0, package);
+    }
+    if ((destinations & ROUTE_UART1) && !isRegenerated(port, UART1, package))
+    {
+        MIDI_OUT_SendPackage(UART1, package);
+        macroChanged(UART1, package);
+    }
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// returns true if a message is not forwarded to the target port because the
+// clock output sends clock and transport of the sync source there, or
+// because the master clock is running
+/////////////////////////////////////////////////////////////////////////////
+static bool isRegenerated(mios32_midi_port_t port, mios32_midi_port_t target, mios32_midi_package_t package)
+{
+    if ((package.type != 0xf) || (package.evnt0 < 0xF8) || (package.evnt0 > 0xFC))
+        return false;
+    if (settings.readable.syncSource == syncToInternal)
+        return true;
+    return isSyncSource(port) && CLOCK_OUT_PortEnabled(target);
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// This task handles the clock and transport messages of the sync source
+/////////////////////////////////////////////////////////////////////////////
+static void TASK_Sync(void *pvParameters)
+{
+    portTickType xLastExecutionTime = xTaskGetTickCount();
+
+    while (1)
+    {
+        vTaskDelayUntil(&xLastExecutionTime, 1 / portTICK_RATE_MS);
+
+        MUTEX_STATE_TAKE;
+        midiInEvent_t event;
+        while (MIDI_IN_Pop(&event))
+            handleRealtimeEvent(event.byte, event.value, event.time);
+
+        checkPreDispatch(TIMEBASE_Get());
+        MIDI_OUT_Flush();
+        MUTEX_STATE_GIVE;
+    }
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// returns the length of the sync cycle in clock ticks
+/////////////////////////////////////////////////////////////////////////////
+static int syncCycleLength()
+{
+    return settings.readable.syncNominator * settings.readable.syncDenominator * 6;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// derives the phase of the sync cycle from the song position, so the sync
+// points fall on the bar lines of the song. The queued changes move along.
+/////////////////////////////////////////////////////////////////////////////
+static void syncToSongPosition()
+{
+    syncCounter = songPosition % syncCycleLength();
+    preDispatchArmed = 0;
+    rescheduleActions();
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// runs the sync logic for one realtime message or song position pointer.
+// value is the song position (0xF2 only), time is the moment the message
+// has been received.
+/////////////////////////////////////////////////////////////////////////////
+static void handleRealtimeEvent(u8 midi_byte, u16 value, u32 time)
+{
+    int syncMax = syncCycleLength();
+    switch (midi_byte)
+    {
+        case 0xF2: // song position pointer, counts 1/16th notes of 6 ticks each
+            {
+                songPosition = (u32)value * 6;
+                syncToSongPosition();
+                motionRelocated();
+            } break;
+        case 0xF8: // clock
+            {
+                lastSyncEventTime = time;
+                TEMPO_Clock(time);
+                CLOCK_OUT_Clock();
+                if (!tempoReported && TEMPO_IsLocked())
                 {
-                    runMode = running;
-                } break;
-            case 0xFC: // stop
+                    reportTempo();
+                    tempoReported = 1;
+                }
+
+                if (runMode == running)
                 {
-                    runMode = stopped;
-                    syncCounter = 0;
-                    triggerKillSync();
-                    triggerSceneSync();
-                    triggerMuteSync();
-                } break;
-            default:
-                break;
-        }
+                    sendRampValues(RAMP_Tick());
+                    songPosition++;
+                    syncCounter++;
+                    if (syncCounter >= syncMax)
+                        syncCounter = 0;
+                    motionTick();
+
+                    // apply the changes which are due on this tick
+                    SCHED_Tick();
+                    if (syncGrid(songPosition))
+                        TRACE_RecordAt(time, TRACE_SYNC_POINT, songPosition);
+                    fireActions();
+                    armPreDispatch();
+                }
+            } break;
+        case 0xFA: // start
+            {
+                runMode = running;
+                lastSyncEventTime = time;
+                CLOCK_OUT_Start();
+                syncCounter = 0;
+                songPosition = 0;
+                preDispatchArmed = 0;
+                TRACE_RecordAt(time, TRACE_SYNC_POINT, songPosition);
+                traceActions((1 << NUM_ACTIONS) - 1, songPosition);
+                triggerKillSync();
+                triggerSceneSync();
+                triggerMuteSync();
+                triggerMacroSync();
+                motionRelocated();
+            } break;
+        case 0xFB: // continue
+            {
+                runMode = running;
+                lastSyncEventTime = time;
+                CLOCK_OUT_Continue();
+                // resume at the song position of the last stop or pointer,
+                // the changes due on this position are applied right away
+                syncToSongPosition();
+                u8 due = syncGrid(songPosition);
+                if (due)
+                    TRACE_RecordAt(time, TRACE_SYNC_POINT, songPosition);
+                traceActions(due, songPosition);
+                int i;
+                for (i = 0; i < NUM_ACTIONS; i++)
+                    if (due & (1 << i))
+                        triggerAction(i);
+                motionRelocated();
+            } break;
+        case 0xFC: // stop
+            {
+                if ((runMode == running) && TEMPO_IntervalGet())
+                    reportTempo();
+                runMode = stopped;
+                CLOCK_OUT_Stop();
+                syncCounter = 0;
+                preDispatchArmed = 0;
+                sendRampValues(RAMP_Finish());
+                triggerKillSync();
+                triggerSceneSync();
+                triggerMuteSync();
+                triggerMacroSync();
+            } break;
+        default:
+            break;
     }
-    return 0; // no error, no filtering
 }
@@ -0,0 +1,269 @@
+/* Re-clocked MIDI clock output.
+
+   Incoming clock ticks arrive with the jitter of the source and of the MIDI
+   merge path. Instead of forwarding them, the ticks of the next incoming
+   interval are scheduled at the times predicted by the tempo tracker
+   (tempo.c), whose filtered phase follows the source without its jitter.
+   A hardware timer checks the schedule every CLOCK_OUT_TIMER_PERIOD uS and
+   sends the due ticks through MIDI_OUT_SendPackage, which puts realtime
+   messages in front of everything else that is waiting for the UART. The
+   same timer keeps the UART buffers of the output stage short.
+
+   Every incoming tick schedules the output ticks of exactly one interval,
+   so the number of ticks sent never drifts from the number received. With
+   a multiplier, the interval is split into that many ticks; with a
+   divider, only every n-th interval (counted from the start message) gets
+   a tick. Start, stop and continue messages of the sync source are sent
+   from here as well, so they can't be overtaken by a tick.
+
+   The schedule is written by the sync task and read by the timer
+   interrupt, so it is only accessed with interrupts disabled.
+*/
+
+/////////////////////////////////////////////////////////////////////////////
+// Include files
+/////////////////////////////////////////////////////////////////////////////
+
+#include <mios32.h>
+#include "clock_out.h"
+#include "midi_out.h"
+#include "tempo.h"
+#include "timebase.h"
+
+typedef struct
+{
+    mios32_midi_port_t port;
+    u8 enabled;
+    u8 multiply;
+    u8 divide;
+    u8 divideCounter;
+    u32 queue[CLOCK_OUT_QUEUE_SIZE];  // times of the scheduled ticks
+    u8 queueHead;
+    u8 queueTail;
+} clockOutPort_t;
+
+#define NUM_PORTS (sizeof(ports)/sizeof(clockOutPort_t))
+
+static clockOutPort_t ports[] =
+{
+    { .port = UART0 },
+    { .port = UART1 },
+};
+
+// true == the next incoming tick is the first one after start
+static u8 firstTick;
+
+// local prototypes
+static clockOutPort_t *findPort(mios32_midi_port_t port);
+static void schedule(clockOutPort_t *p, u32 time);
+static void sendRealtime(clockOutPort_t *p, u8 midi_byte);
+static void TIMER_ClockOut(void);
+
+static clockOutPort_t *findPort(mios32_midi_port_t port)
+{
+    int i;
+    for (i = 0; i < NUM_PORTS; i++)
+    {
+        if (ports[i].port == port)
+            return &ports[i];
+    }
+    return NULL;
+}
+
+static void schedule(clockOutPort_t *p, u32 time)
+{
+    if ((u8)(p->queueTail - p->queueHead) < CLOCK_OUT_QUEUE_SIZE)
+        p->queue[p->queueTail++ & (CLOCK_OUT_QUEUE_SIZE - 1)] = time;
+}
+
+static void sendRealtime(clockOutPort_t *p, u8 midi_byte)
+{
+    mios32_midi_package_t package;
+    package.ALL = 0;
+    package.type = 0xf;
+    package.evnt0 = midi_byte;
+    MIDI_OUT_SendPackage(p->port, package);
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// timer interrupt: sends the ticks which are due, then refills the UARTs
+/////////////////////////////////////////////////////////////////////////////
+static void TIMER_ClockOut(void)
+{
+    u32 now = TIMEBASE_Get();
+    int i;
+
+    MIOS32_IRQ_Disable();
+    for (i = 0; i < NUM_PORTS; i++)
+    {
+        clockOutPort_t *p = &ports[i];
+        while ((p->queueHead != p->queueTail)
+               && ((s32)(now - p->queue[p->queueHead & (CLOCK_OUT_QUEUE_SIZE - 1)]) >= 0))
+        {
+            p->queueHead++;
+            sendRealtime(p, 0xf8);
+        }
+    }
+    MIOS32_IRQ_Enable();
+
+    MIDI_OUT_Service();
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// initializes the clock output and starts the timer. All ports are disabled.
+/////////////////////////////////////////////////////////////////////////////
+s32 CLOCK_OUT_Init(void)
+{
+    int i;
+    for (i = 0; i < NUM_PORTS; i++)
+    {
+        ports[i].enabled = 0;
+        ports[i].multiply = 1;
+        ports[i].divide = 1;
+        ports[i].divideCounter = 0;
+        ports[i].queueHead = 0;
+        ports[i].queueTail = 0;
+    }
+    firstTick = 1;
+
+    return MIOS32_TIMER_Init(CLOCK_OUT_TIMER, CLOCK_OUT_TIMER_PERIOD, TIMER_ClockOut, MIOS32_IRQ_PRIO_HIGH);
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// enables the re-clocked output on a port (MIDI 1 or the Rytm)
+// multiply: 1..CLOCK_OUT_MULTIPLY_MAX output ticks per incoming tick
+// divide:   1 output tick every 1..255 incoming ticks
+/////////////////////////////////////////////////////////////////////////////
+s32 CLOCK_OUT_PortSet(mios32_midi_port_t port, u8 enable, u8 multiply, u8 divide)
+{
+    clockOutPort_t *p = findPort(port);
+    if (!p)
+        return -1;
+    if ((multiply < 1) || (multiply > CLOCK_OUT_MULTIPLY_MAX) || (divide < 1))
+        return -2;
+
+    MIOS32_IRQ_Disable();
+    p->enabled = enable;
+    p->multiply = multiply;
+    p->divide = divide;
+    if (!enable)
+        p->queueHead = p->queueTail;
+    MIOS32_IRQ_Enable();
+    return 0;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// returns 1 if the clock of this port is generated here
+/////////////////////////////////////////////////////////////////////////////
+u8 CLOCK_OUT_PortEnabled(mios32_midi_port_t port)
+{
+    clockOutPort_t *p = findPort(port);
+    return p ? p->enabled : 0;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// sends a start message. The next incoming tick is sent immediately and
+// restarts the dividers.
+/////////////////////////////////////////////////////////////////////////////
+s32 CLOCK_OUT_Start(void)
+{
+    int i;
+    MIOS32_IRQ_Disable();
+    for (i = 0; i < NUM_PORTS; i++)
+    {
+        if (!ports[i].enabled)
+            continue;
+        ports[i].queueHead = ports[i].queueTail;
+        ports[i].divideCounter = 0;
+        sendRealtime(&ports[i], 0xfa);
+    }
+    firstTick = 1;
+    MIOS32_IRQ_Enable();
+    return 0;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// sends a stop message. Ticks which haven't been received yet are dropped.
+/////////////////////////////////////////////////////////////////////////////
+s32 CLOCK_OUT_Stop(void)
+{
+    int i;
+    MIOS32_IRQ_Disable();
+    for (i = 0; i < NUM_PORTS; i++)
+    {
+        if (!ports[i].enabled)
+            continue;
+        ports[i].queueHead = ports[i].queueTail;
+        sendRealtime(&ports[i], 0xfc);
+    }
+    firstTick = 1;
+    MIOS32_IRQ_Enable();
+    return 0;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// sends a continue message. The next incoming tick is sent immediately.
+/////////////////////////////////////////////////////////////////////////////
+s32 CLOCK_OUT_Continue(void)
+{
+    int i;
+    MIOS32_IRQ_Disable();
+    for (i = 0; i < NUM_PORTS; i++)
+    {
+        if (!ports[i].enabled)
+            continue;
+        ports[i].queueHead = ports[i].queueTail;
+        sendRealtime(&ports[i], 0xfb);
+    }
+    firstTick = 1;
+    MIOS32_IRQ_Enable();
+    return 0;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// has to be called for each incoming tick, after it has been passed to the
+// tempo tracker. Schedules the output ticks of the next interval.
+/////////////////////////////////////////////////////////////////////////////
+s32 CLOCK_OUT_Clock(void)
+{
+    u32 interval = TEMPO_IntervalGet();
+    u32 now = TEMPO_PredictTime(0);
+    u32 next = TEMPO_PredictTime(1);
+    int i, j;
+
+    MIOS32_IRQ_Disable();
+    for (i = 0; i < NUM_PORTS; i++)
+    {
+        clockOutPort_t *p = &ports[i];
+        if (!p->enabled)
+            continue;
+
+        if (firstTick || !interval)
+        {
+            // the tick hasn't been scheduled before, it goes out right now
+            p->queueHead = p->queueTail;
+            if (p->divideCounter == 0)
+            {
+                sendRealtime(p, 0xf8);
+                for (j = 1; interval && (j < p->multiply); j++)
+                    schedule(p, now + j * interval / p->multiply);
+            }
+            if (++p->divideCounter >= p->divide)
+                p->divideCounter = 0;
+        }
+
+        if (interval)
+        {
+            if (p->divideCounter == 0)
+            {
+                for (j = 0; j < p->multiply; j++)
+                    schedule(p, next + j * interval / p->multiply);
+            }
+            if (++p->divideCounter >= p->divide)
+                p->divideCounter = 0;
+        }
+    }
+    firstTick = interval ? 0 : 1;
+    MIOS32_IRQ_Enable();
+    return 0;
+}
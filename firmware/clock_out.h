@@ -0,0 +1,46 @@
+/*
+ * Header file of the re-clocked MIDI clock output
+ *
+ * ==========================================================================
+ *
+ *  Licensed for personal non-commercial use only.
+ *  All other rights reserved.
+ *
+ * ==========================================================================
+ */
+
+#ifndef _CLOCK_OUT_H
+#define _CLOCK_OUT_H
+
+
+/////////////////////////////////////////////////////////////////////////////
+// Global definitions
+/////////////////////////////////////////////////////////////////////////////
+
+// the MIOS32 timer which sends the clock ticks
+#define CLOCK_OUT_TIMER 1
+
+// period of the timer (uS), the max. deviation of a tick from its schedule
+#define CLOCK_OUT_TIMER_PERIOD 100
+
+// max. clock multiplier (output ticks per incoming tick)
+#define CLOCK_OUT_MULTIPLY_MAX 4
+
+// scheduled ticks per port (must be a power of 2, >= 2 * CLOCK_OUT_MULTIPLY_MAX)
+#define CLOCK_OUT_QUEUE_SIZE 16
+
+
+/////////////////////////////////////////////////////////////////////////////
+// Prototypes
+/////////////////////////////////////////////////////////////////////////////
+
+extern s32 CLOCK_OUT_Init(void);
+extern s32 CLOCK_OUT_PortSet(mios32_midi_port_t port, u8 enable, u8 multiply, u8 divide);
+extern u8  CLOCK_OUT_PortEnabled(mios32_midi_port_t port);
+extern s32 CLOCK_OUT_Start(void);
+extern s32 CLOCK_OUT_Stop(void);
+extern s32 CLOCK_OUT_Continue(void);
+extern s32 CLOCK_OUT_Clock(void);
+
+
+#endif /* _CLOCK_OUT_H */
@@ -0,0 +1,41 @@
+/*
+ * Host-side replacement for the FreeRTOS kernel header
+ *
+ * Tasks are run cooperatively by the simulation engine, see sim_freertos.c
+ *
+ * ==========================================================================
+ *
+ *  Licensed for personal non-commercial use only.
+ *  All other rights reserved.
+ *
+ * ==========================================================================
+ */
+
+#ifndef _FREERTOS_H
+#define _FREERTOS_H
+
+#include <mios32.h>
+
+
+/////////////////////////////////////////////////////////////////////////////
+// Global definitions
+/////////////////////////////////////////////////////////////////////////////
+
+#define pdTRUE  1
+#define pdFALSE 0
+#define pdPASS  pdTRUE
+
+#define tskIDLE_PRIORITY 0
+#define configMINIMAL_STACK_SIZE 128
+#define portTICK_RATE_MS 1
+
+
+/////////////////////////////////////////////////////////////////////////////
+// Global Types
+/////////////////////////////////////////////////////////////////////////////
+
+#define portCHAR      char
+#define portBASE_TYPE long
+typedef u32 portTickType;
+
+#endif /* _FREERTOS_H */
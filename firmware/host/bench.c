@@ -0,0 +1,1039 @@
+/* Latency benchmark for the host simulation build.
+
+   Replays a scenario script against app.c and reports the bytes on the
+   wire per port, the queue-to-wire latency of the UART traffic, the jitter
+   of the clock ticks sent on each UART and how late the expected messages
+   of each queued action land after the sync point they have been queued
+   for. The exit status is 1 if an expected message has not been sent, a
+   message which must not be sent has been or a pot reports the wrong
+   value.
+
+   Usage: rytm_bench [-v] [-l wire_log.csv] [-u usb0.syx] <script>
+
+   -u writes the bytes sent on USB0, e.g. a trace dump for trace_decode.
+
+   Script syntax (one statement per line, '#' starts a comment, times in mS):
+        name <text>                 title of the scenario
+        bpm <bpm>                   tempo of the incoming clock (default 120)
+        clockport <USB0|UART0|UART1|internal>
+                                    port the clock arrives on (default UART0).
+                                    internal: the app runs its master clock,
+                                    the sync points are taken from the start
+                                    and clock messages it sends to the Rytm
+        jitter <uS>                 uniform random jitter of each clock tick
+        seed <n>                    seed for the jitter generator
+        cycle <ticks>               sync cycle length configured in the app
+                                    (default 96 = 8 x 1/8th)
+        potinit <pot> <value>       pot value (0..4095) at power-on
+        potnoise <lsb>              max. deviation of each conversion result
+                                    from the pot value
+        end <ms>                    length of the simulation
+
+        at <ms> start               send 0xFA, restart the clock phase
+        at <ms> stop                send 0xFC
+        at <ms> continue            send 0xFB
+        at <ms> spp <16ths>         send a song position pointer, the clock
+                                    phase continues from that position
+        at <ms> clock <on|off>      start/stop sending 0xF8
+        at <ms> bpm <bpm>           change the tempo
+        at <ms> press <switch>      press a button (0..14)
+        at <ms> release <switch>
+        at <ms> tap <switch>        press, release 30 mS later
+        at <ms> pot <pot> <value>
+        at <ms> sweep <pot> <from> <to> <duration ms>
+        at <ms> midi <port> <hex bytes...>
+                                    up to 32 bytes per statement; longer
+                                    messages continue in the next statement
+        at <ms> expect [<port>] <chn 1..16> <cc> <value|*|none> [sync|now]
+                                    the last action must result in this CC
+                                    (* == any value) on the port (default
+                                    UART1); lateness is measured against the
+                                    next sync point (sync, default) or
+                                    against the time of the expectation
+                                    (now). none: the CC must not be sent
+                                    from then on, with any value
+        at <ms> sysex <port> <hex bytes|*...>
+                                    a SysEx message starting with these bytes
+                                    (* == any byte) must be sent on the port
+        at <ms> nosysex <port> <hex bytes|*...>
+                                    no such message may be sent from then on
+        at <ms> potvalue <pot> <value>
+                                    the filtered value of the pot (14 bit)
+                                    must be this at that time
+*/
+
+/////////////////////////////////////////////////////////////////////////////
+// Include files
+/////////////////////////////////////////////////////////////////////////////
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include <mios32.h>
+#include "app.h"
+#include "sim.h"
+#include "pots.h"
+
+#define MAX_EVENTS       100000
+#define MAX_EXPECTATIONS 256
+#define MAX_SYSEX_CHECKS 64
+#define MAX_POT_CHECKS   64
+#define MAX_SYNC_POINTS  4096
+
+// arguments of a statement: a midi statement takes the port and 32 bytes
+#define MAX_ARGS         33
+
+// expected value which matches any value
+#define ANY_VALUE        0xff
+// expected value of a CC which must not be sent
+#define NO_VALUE         0xfe
+
+// longer pauses between two clock ticks on the wire are not counted as jitter
+#define CLOCK_GAP_US     250000
+
+typedef enum
+{
+    evStart,
+    evStop,
+    evContinue,
+    evSpp,
+    evClockOn,
+    evClockOff,
+    evBpm,
+    evPress,
+    evRelease,
+    evPot,
+    evMidi,
+    evExpect,
+    evSysex,
+    evPotValue
+} event_type_t;
+
+typedef struct
+{
+    u32 time;
+    u32 order;
+    event_type_t type;
+    int a, b, c;
+    double value;
+    mios32_midi_port_t port;
+    u8 bytes[32];
+    int len;
+    u8 synced;
+} event_t;
+
+typedef struct
+{
+    u32 time;
+    mios32_midi_port_t port;
+    u8 status;
+    u8 cc;
+    u8 value;
+    u8 synced;
+    u32 reference;
+    u32 done;
+    u8 matched;
+} expectation_t;
+
+typedef struct
+{
+    u32 time;
+    mios32_midi_port_t port;
+    u8 pattern[32];     // ANY_VALUE matches any byte
+    int len;
+    u8 absent;          // the message must not be sent
+    u32 sent;           // time of the F0 of the first matching message
+    u8 matched;
+} sysexCheck_t;
+
+typedef struct
+{
+    u32 time;
+    u8 pot;
+    u16 expected;
+    u16 value;          // reported by the pot filter at that time
+} potCheck_t;
+
+static char scenarioName[128] = "unnamed scenario";
+static double bpm = 120.0;
+static mios32_midi_port_t clockPort = UART0;
+static int internalClock;
+static u32 jitterUs;
+static u32 seed = 1;
+static int cycleTicks = 96;
+static u32 endTime = 10000000;
+
+static event_t *events;
+static u32 numEvents;
+static expectation_t expectations[MAX_EXPECTATIONS];
+static u32 numExpectations;
+static sysexCheck_t sysexChecks[MAX_SYSEX_CHECKS];
+static u32 numSysexChecks;
+static potCheck_t potChecks[MAX_POT_CHECKS];
+static u32 numPotChecks;
+static u32 syncPoints[MAX_SYNC_POINTS];
+static u32 numSyncPoints;
+
+/////////////////////////////////////////////////////////////////////////////
+// Script parser
+/////////////////////////////////////////////////////////////////////////////
+
+static int parsePort(const char *s, mios32_midi_port_t *port)
+{
+    if (!strcmp(s, "USB0"))
+        *port = USB0;
+    else if (!strcmp(s, "UART0"))
+        *port = UART0;
+    else if (!strcmp(s, "UART1"))
+        *port = UART1;
+    else
+        return -1;
+    return 0;
+}
+
+static event_t *addEvent(double ms, event_type_t type)
+{
+    event_t *e;
+    if (numEvents >= MAX_EVENTS)
+    {
+        fprintf(stderr, "too many events\n");
+        exit(1);
+    }
+    e = &events[numEvents];
+    memset(e, 0, sizeof(event_t));
+    e->time = (u32)(ms * 1000.0 + 0.5);
+    e->order = numEvents++;
+    e->type = type;
+    return e;
+}
+
+static int compareEvents(const void *a, const void *b)
+{
+    const event_t *ea = a, *eb = b;
+    if (ea->time != eb->time)
+        return (ea->time < eb->time) ? -1 : 1;
+    return (ea->order < eb->order) ? -1 : 1;
+}
+
+static int parseAt(double ms, char *cmd, const char *file, int line)
+{
+    char *arg[MAX_ARGS];
+    int n = 0;
+    char *tok;
+    for (tok = strtok(NULL, " \t"); tok && n < MAX_ARGS; tok = strtok(NULL, " \t"))
+        arg[n++] = tok;
+
+    if (!strcmp(cmd, "start"))
+        addEvent(ms, evStart);
+    else if (!strcmp(cmd, "stop"))
+        addEvent(ms, evStop);
+    else if (!strcmp(cmd, "continue"))
+        addEvent(ms, evContinue);
+    else if (!strcmp(cmd, "spp") && n == 1)
+        addEvent(ms, evSpp)->a = atoi(arg[0]);
+    else if (!strcmp(cmd, "clock") && n == 1)
+        addEvent(ms, strcmp(arg[0], "off") ? evClockOn : evClockOff);
+    else if (!strcmp(cmd, "bpm") && n == 1)
+        addEvent(ms, evBpm)->value = atof(arg[0]);
+    else if (!strcmp(cmd, "press") && n == 1)
+        addEvent(ms, evPress)->a = atoi(arg[0]);
+    else if (!strcmp(cmd, "release") && n == 1)
+        addEvent(ms, evRelease)->a = atoi(arg[0]);
+    else if (!strcmp(cmd, "tap") && n == 1)
+    {
+        addEvent(ms, evPress)->a = atoi(arg[0]);
+        addEvent(ms + 30, evRelease)->a = atoi(arg[0]);
+    }
+    else if (!strcmp(cmd, "pot") && n == 2)
+    {
+        event_t *e = addEvent(ms, evPot);
+        e->a = atoi(arg[0]);
+        e->b = atoi(arg[1]);
+    }
+    else if (!strcmp(cmd, "sweep") && n == 4)
+    {
+        int pot = atoi(arg[0]), from = atoi(arg[1]), to = atoi(arg[2]), duration = atoi(arg[3]);
+        int t;
+        for (t = 0; t <= duration; t++)
+        {
+            event_t *e = addEvent(ms + t, evPot);
+            e->a = pot;
+            e->b = from + (to - from) * t / (duration ? duration : 1);
+        }
+    }
+    else if (!strcmp(cmd, "midi") && n >= 2)
+    {
+        event_t *e = addEvent(ms, evMidi);
+        int i;
+        if (parsePort(arg[0], &e->port) < 0)
+            goto error;
+        for (i = 1; i < n; i++)
+            e->bytes[e->len++] = strtol(arg[i], NULL, 16);
+    }
+    else if (!strcmp(cmd, "expect") && (n >= 3 && n <= 5))
+    {
+        event_t *e = addEvent(ms, evExpect);
+        char **a = arg;
+        e->port = UART1;
+        if (parsePort(a[0], &e->port) == 0)
+        {
+            a++;
+            n--;
+        }
+        if (n < 3 || n > 4)
+            goto error;
+        e->a = 0xb0 | ((atoi(a[0]) - 1) & 0x0f);
+        e->b = atoi(a[1]);
+        if (!strcmp(a[2], "*"))
+            e->c = ANY_VALUE;
+        else if (!strcmp(a[2], "none"))
+            e->c = NO_VALUE;
+        else
+            e->c = atoi(a[2]);
+        e->synced = (n == 3) || strcmp(a[3], "now");
+    }
+    else if ((!strcmp(cmd, "sysex") || !strcmp(cmd, "nosysex")) && n >= 2)
+    {
+        event_t *e = addEvent(ms, evSysex);
+        int i;
+        if (parsePort(arg[0], &e->port) < 0)
+            goto error;
+        for (i = 1; i < n; i++)
+            e->bytes[e->len++] = strcmp(arg[i], "*") ? strtol(arg[i], NULL, 16) : ANY_VALUE;
+        e->a = (cmd[0] == 'n');
+    }
+    else if (!strcmp(cmd, "potvalue") && n == 2)
+    {
+        event_t *e = addEvent(ms, evPotValue);
+        e->a = atoi(arg[0]);
+        e->b = atoi(arg[1]);
+    }
+    else
+        goto error;
+    return 0;
+
+error:
+    fprintf(stderr, "%s:%d: invalid statement '%s'\n", file, line, cmd);
+    return -1;
+}
+
+static int parseScript(const char *file)
+{
+    char buffer[512];
+    char *cmd = NULL;
+    int line = 0;
+    FILE *f = fopen(file, "r");
+    if (!f)
+    {
+        perror(file);
+        return -1;
+    }
+
+    while (fgets(buffer, sizeof(buffer), f))
+    {
+        char *arg;
+        char *comment = strchr(buffer, '#');
+        line++;
+        if (comment)
+            *comment = 0;
+        buffer[strcspn(buffer, "\r\n")] = 0;
+
+        if (!strncmp(buffer, "name ", 5))
+        {
+            snprintf(scenarioName, sizeof(scenarioName), "%.127s", buffer + 5);
+            continue;
+        }
+
+        cmd = strtok(buffer, " \t");
+        if (!cmd)
+            continue;
+
+        if (!strcmp(cmd, "at"))
+        {
+            char *time = strtok(NULL, " \t");
+            char *what = strtok(NULL, " \t");
+            if (!time || !what || parseAt(atof(time), what, file, line) < 0)
+            {
+                fclose(f);
+                return -1;
+            }
+            continue;
+        }
+
+        arg = strtok(NULL, " \t");
+        if (!arg)
+            goto error;
+        if (!strcmp(cmd, "bpm"))
+            bpm = atof(arg);
+        else if (!strcmp(cmd, "clockport"))
+        {
+            if (!strcmp(arg, "internal"))
+                internalClock = 1;
+            else if (parsePort(arg, &clockPort) < 0)
+                goto error;
+        }
+        else if (!strcmp(cmd, "jitter"))
+            jitterUs = atoi(arg);
+        else if (!strcmp(cmd, "seed"))
+            seed = atoi(arg);
+        else if (!strcmp(cmd, "cycle"))
+            cycleTicks = atoi(arg);
+        else if (!strcmp(cmd, "end"))
+            endTime = (u32)(atof(arg) * 1000.0);
+        else if (!strcmp(cmd, "potnoise"))
+            SIM_AIN_NoiseSet(atoi(arg));
+        else if (!strcmp(cmd, "potinit"))
+        {
+            char *value = strtok(NULL, " \t");
+            if (!value)
+                goto error;
+            SIM_AIN_Set(atoi(arg), atoi(value));
+        }
+        else
+            goto error;
+    }
+    fclose(f);
+
+    qsort(events, numEvents, sizeof(event_t), compareEvents);
+    return 0;
+
+error:
+    fprintf(stderr, "%s:%d: invalid statement '%s'\n", file, line, cmd);
+    fclose(f);
+    return -1;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// Scenario playback
+/////////////////////////////////////////////////////////////////////////////
+
+static u32 nextRandom(void)
+{
+    seed = seed * 1103515245 + 12345;
+    return (seed >> 16) & 0x7fff;
+}
+
+static u32 jitteredClockTime(double ideal)
+{
+    s32 jitter = jitterUs ? (s32)(nextRandom() % (2 * jitterUs + 1)) - (s32)jitterUs : 0;
+    return (u32)(ideal + 0.5) + jitter;
+}
+
+static void sendByte(mios32_midi_port_t port, u8 b)
+{
+    SIM_MIDI_Receive(port, &b, 1);
+}
+
+static void run(void)
+{
+    u32 e = 0;
+    int clockOn = 0;
+    int transportRunning = 0;
+    u32 tickCount = 0;
+    double clockIdeal = 0;
+    u32 clockTime = 0;
+
+    while (1)
+    {
+        u32 next = endTime;
+        int isClock = 0;
+
+        if (clockOn && clockTime < next)
+        {
+            next = clockTime;
+            isClock = 1;
+        }
+        if (e < numEvents && events[e].time <= next)
+        {
+            next = events[e].time;
+            isClock = 0;
+        }
+        if (next >= endTime)
+            break;
+
+        SIM_RunUntil(next);
+
+        if (isClock)
+        {
+            sendByte(clockPort, 0xf8);
+            clockIdeal += 60000000.0 / (bpm * 24.0);
+            clockTime = jitteredClockTime(clockIdeal);
+            if (transportRunning)
+            {
+                tickCount++;
+                if ((tickCount % cycleTicks) == 0 && numSyncPoints < MAX_SYNC_POINTS)
+                    syncPoints[numSyncPoints++] = SIM_TimeGet();
+            }
+            continue;
+        }
+
+        switch (events[e].type)
+        {
+            case evStart:
+                sendByte(clockPort, 0xfa);
+                transportRunning = 1;
+                tickCount = 0;
+                if (numSyncPoints < MAX_SYNC_POINTS)
+                    syncPoints[numSyncPoints++] = SIM_TimeGet();
+                clockOn = 1;
+                clockIdeal = next;
+                clockTime = next;
+                break;
+            case evStop:
+                sendByte(clockPort, 0xfc);
+                transportRunning = 0;
+                break;
+            case evContinue:
+                sendByte(clockPort, 0xfb);
+                transportRunning = 1;
+                break;
+            case evSpp:
+                sendByte(clockPort, 0xf2);
+                sendByte(clockPort, events[e].a & 0x7f);
+                sendByte(clockPort, (events[e].a >> 7) & 0x7f);
+                tickCount = events[e].a * 6;
+                break;
+            case evClockOn:
+                if (!clockOn)
+                {
+                    clockIdeal = next;
+                    clockTime = next;
+                }
+                clockOn = 1;
+                break;
+            case evClockOff:
+                clockOn = 0;
+                break;
+            case evBpm:
+                bpm = events[e].value;
+                break;
+            case evPress:
+                SIM_DIN_Set(events[e].a, 0);
+                break;
+            case evRelease:
+                SIM_DIN_Set(events[e].a, 1);
+                break;
+            case evPot:
+                SIM_AIN_Set(events[e].a, events[e].b);
+                break;
+            case evMidi:
+                SIM_MIDI_Receive(events[e].port, events[e].bytes, events[e].len);
+                break;
+            case evExpect:
+                if (numExpectations < MAX_EXPECTATIONS)
+                {
+                    expectation_t *x = &expectations[numExpectations++];
+                    memset(x, 0, sizeof(expectation_t));
+                    x->time = next;
+                    x->port = events[e].port;
+                    x->status = events[e].a;
+                    x->cc = events[e].b;
+                    x->value = events[e].c;
+                    x->synced = events[e].synced;
+                }
+                break;
+            case evSysex:
+                if (numSysexChecks < MAX_SYSEX_CHECKS)
+                {
+                    sysexCheck_t *x = &sysexChecks[numSysexChecks++];
+                    memset(x, 0, sizeof(sysexCheck_t));
+                    x->time = next;
+                    x->port = events[e].port;
+                    memcpy(x->pattern, events[e].bytes, events[e].len);
+                    x->len = events[e].len;
+                    x->absent = events[e].a;
+                }
+                break;
+            case evPotValue:
+                if (numPotChecks < MAX_POT_CHECKS)
+                {
+                    potCheck_t *x = &potChecks[numPotChecks++];
+                    x->time = next;
+                    x->pot = events[e].a;
+                    x->expected = events[e].b;
+                    x->value = POTS_ValueGet(events[e].a);
+                }
+                break;
+        }
+        e++;
+    }
+    SIM_RunUntil(endTime);
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// Analysis
+/////////////////////////////////////////////////////////////////////////////
+
+/////////////////////////////////////////////////////////////////////////////
+// with the internal master clock, the sync points are the start message and
+// every cycle-th clock tick after it on the way to the Rytm
+/////////////////////////////////////////////////////////////////////////////
+static void findSyncPoints(const sim_wire_byte_t *log, u32 num)
+{
+    int running = 0;
+    u32 ticks = 0;
+    u32 i;
+
+    numSyncPoints = 0;
+    for (i = 0; i < num && numSyncPoints < MAX_SYNC_POINTS; i++)
+    {
+        if (log[i].port != UART1)
+            continue;
+        if (log[i].byte == 0xfa)
+        {
+            running = 1;
+            ticks = 0;
+            syncPoints[numSyncPoints++] = log[i].start;
+        }
+        else if (log[i].byte == 0xfc)
+            running = 0;
+        else if (log[i].byte == 0xf8 && running && (++ticks % cycleTicks) == 0)
+            syncPoints[numSyncPoints++] = log[i].start;
+    }
+}
+
+static void matchExpectations(const sim_wire_byte_t *log, u32 num)
+{
+    static const mios32_midi_port_t ports[] = { USB0, UART0, UART1 };
+    u32 p, i, x;
+
+    for (x = 0; x < numExpectations; x++)
+    {
+        expectation_t *exp = &expectations[x];
+        exp->reference = exp->time;
+        if (exp->synced)
+        {
+            u32 s;
+            exp->reference = 0xffffffff;
+            for (s = 0; s < numSyncPoints; s++)
+            {
+                if (syncPoints[s] >= exp->time)
+                {
+                    exp->reference = syncPoints[s];
+                    break;
+                }
+            }
+        }
+    }
+
+    // decode the stream of each port into messages (running status aware)
+    for (p = 0; p < sizeof(ports) / sizeof(ports[0]); p++)
+    {
+        u8 runningStatus = 0;
+        u8 msg[3];
+        u8 len = 0;
+
+        for (i = 0; i < num; i++)
+        {
+            u8 b = log[i].byte;
+            if (log[i].port != ports[p] || b >= 0xf8)
+                continue;
+            if (b & 0x80)
+            {
+                runningStatus = (b < 0xf0) ? b : 0;
+                len = 0;
+                continue;
+            }
+            if (!runningStatus)
+                continue;
+            msg[len++] = b;
+            if (len < (((runningStatus & 0xe0) == 0xc0) ? 1 : 2))
+                continue;
+            len = 0;
+
+            // a message fulfills the first open expectation, and shows up
+            // every expectation of its absence
+            int taken = 0;
+            for (x = 0; x < numExpectations; x++)
+            {
+                expectation_t *exp = &expectations[x];
+                int absent = (exp->value == NO_VALUE);
+                if (exp->matched || (taken && !absent) || exp->port != ports[p] || exp->status != runningStatus ||
+                    exp->cc != msg[0] || log[i].queued < exp->time)
+                    continue;
+                if (absent || exp->value == ANY_VALUE || exp->value == msg[1])
+                {
+                    exp->matched = 1;
+                    exp->done = log[i].done;
+                    if (!absent)
+                        taken = 1;
+                }
+            }
+        }
+    }
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// collects the SysEx messages per port and checks them against the
+// patterns. A message fulfills the first open check it matches.
+/////////////////////////////////////////////////////////////////////////////
+static void matchSysex(const sim_wire_byte_t *log, u32 num)
+{
+    static const mios32_midi_port_t ports[] = { USB0, UART0, UART1 };
+    u32 p, i, x;
+
+    for (p = 0; p < sizeof(ports) / sizeof(ports[0]); p++)
+    {
+        u8 msg[32];
+        int len = -1;   // outside of a message
+        u32 start = 0;
+
+        for (i = 0; i < num; i++)
+        {
+            u8 b = log[i].byte;
+            if (log[i].port != ports[p] || b >= 0xf8)
+                continue;
+            if (b == 0xf0)
+            {
+                len = 0;
+                start = log[i].queued;
+            }
+            else if (len < 0)
+                continue;
+            if (len < (int)sizeof(msg))
+                msg[len] = b;
+            len++;
+            if ((b != 0xf7) && ((b < 0x80) || (b == 0xf0)))
+                continue;
+
+            // F7 or another status byte ends the message
+            int taken = 0;
+            for (x = 0; x < numSysexChecks; x++)
+            {
+                sysexCheck_t *c = &sysexChecks[x];
+                int k;
+                if (c->matched || c->port != ports[p] || start < c->time || len < c->len)
+                    continue;
+                if (!c->absent && taken)
+                    continue;
+                for (k = 0; k < c->len; k++)
+                    if (c->pattern[k] != ANY_VALUE && c->pattern[k] != msg[k])
+                        break;
+                if (k < c->len)
+                    continue;
+                c->matched = 1;
+                c->sent = start;
+                if (!c->absent)
+                    taken = 1;
+            }
+            len = -1;
+        }
+    }
+}
+
+static void reportWire(const sim_wire_byte_t *log, u32 num, mios32_midi_port_t port)
+{
+    u32 i;
+    u32 bytes = 0, realtime = 0;
+    double sum = 0, sumRt = 0;
+    u32 max = 0, maxRt = 0;
+
+    for (i = 0; i < num; i++)
+    {
+        u32 latency;
+        if (log[i].port != port)
+            continue;
+        latency = log[i].done - log[i].queued;
+        if (log[i].byte >= 0xf8)
+        {
+            realtime++;
+            sumRt += latency;
+            if (latency > maxRt)
+                maxRt = latency;
+        }
+        else
+        {
+            bytes++;
+            sum += latency;
+            if (latency > max)
+                max = latency;
+        }
+    }
+
+    printf("  %-5s %6u bytes (%u realtime)", SIM_PortNameGet(port), bytes + realtime, realtime);
+    if (port != USB0)
+    {
+        printf("   queue->wire: mean %6.2f ms max %6.2f ms", bytes ? sum / bytes / 1000.0 : 0, max / 1000.0);
+        if (realtime)
+            printf("   realtime: mean %5.2f ms max %5.2f ms", sumRt / realtime / 1000.0, maxRt / 1000.0);
+    }
+    printf("\n");
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// prints the deviation of the clock tick intervals from their mean
+/////////////////////////////////////////////////////////////////////////////
+static void reportClock(const sim_wire_byte_t *log, u32 num, mios32_midi_port_t port)
+{
+    u32 i, n = 0;
+    u32 last = 0;
+    int haveLast = 0;
+    double sum = 0, sumSq = 0, maxDev = 0, mean;
+
+    // first pass: mean interval
+    for (i = 0; i < num; i++)
+    {
+        if (log[i].port != port || log[i].byte != 0xf8)
+            continue;
+        if (haveLast && (log[i].start - last) < CLOCK_GAP_US)
+        {
+            sum += log[i].start - last;
+            n++;
+        }
+        last = log[i].start;
+        haveLast = 1;
+    }
+    if (n < 2)
+        return;
+    mean = sum / n;
+
+    // second pass: deviation
+    haveLast = 0;
+    for (i = 0; i < num; i++)
+    {
+        if (log[i].port != port || log[i].byte != 0xf8)
+            continue;
+        if (haveLast && (log[i].start - last) < CLOCK_GAP_US)
+        {
+            double dev = (double)(log[i].start - last) - mean;
+            sumSq += dev * dev;
+            if (dev < 0)
+                dev = -dev;
+            if (dev > maxDev)
+                maxDev = dev;
+        }
+        last = log[i].start;
+        haveLast = 1;
+    }
+    printf("  %-5s clock: %u intervals, mean %6.3f ms, jitter rms %5.3f ms max %5.3f ms\n",
+           SIM_PortNameGet(port), n, mean / 1000.0, sqrt(sumSq / n) / 1000.0, maxDev / 1000.0);
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// prints the SysEx checks, returns the number of failed ones
+/////////////////////////////////////////////////////////////////////////////
+static u32 reportSysex(void)
+{
+    u32 failed = 0;
+    u32 x;
+    int k;
+
+    printf("SysEx messages:\n");
+    for (x = 0; x < numSysexChecks; x++)
+    {
+        sysexCheck_t *c = &sysexChecks[x];
+        printf("  from %9.3f ms  %-5s%s", c->time / 1000.0, SIM_PortNameGet(c->port), c->absent ? " none of" : "");
+        for (k = 0; k < c->len; k++)
+        {
+            if (c->pattern[k] == ANY_VALUE)
+                printf(" *");
+            else
+                printf(" %02X", c->pattern[k]);
+        }
+        if (c->absent)
+            printf(c->matched ? "  SENT at %.3f ms\n" : "  ok\n", c->sent / 1000.0);
+        else if (c->matched)
+            printf("  sent %.3f ms\n", c->sent / 1000.0);
+        else
+            printf("  NOT SENT\n");
+        if (c->matched == c->absent)
+            failed++;
+    }
+    return failed;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// prints the pot checks, returns the number of failed ones
+/////////////////////////////////////////////////////////////////////////////
+static u32 reportPots(void)
+{
+    u32 failed = 0;
+    u32 x;
+
+    printf("pot values:\n");
+    for (x = 0; x < numPotChecks; x++)
+    {
+        potCheck_t *c = &potChecks[x];
+        printf("  at %9.3f ms  pot %-2d =%-5d", c->time / 1000.0, c->pot, c->expected);
+        if (c->value == c->expected)
+            printf("  ok\n");
+        else
+        {
+            printf("  WRONG: %d\n", c->value);
+            failed++;
+        }
+    }
+    return failed;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// prints the results, returns the number of failed expectations and checks
+/////////////////////////////////////////////////////////////////////////////
+static u32 report(void)
+{
+    u32 num, x;
+    const sim_wire_byte_t *log = SIM_WireLogGet(&num);
+    const sim_stats_t *stats = SIM_StatsGet();
+    u32 matched = 0, missing = 0, unexpected = 0;
+    double sumLate = 0;
+    s32 maxLate = -0x7fffffff, minLate = 0x7fffffff;
+
+    if (internalClock)
+        findSyncPoints(log, num);
+    matchExpectations(log, num);
+    matchSysex(log, num);
+
+    printf("== %s ==\n", scenarioName);
+    printf("wire traffic:\n");
+    reportWire(log, num, UART0);
+    reportWire(log, num, UART1);
+    reportWire(log, num, USB0);
+    reportClock(log, num, UART0);
+    reportClock(log, num, UART1);
+    printf("blocking sends: %.2f ms stalled, DOUT calls/tick: %.3f, EEPROM writes: %u, BankStick writes: %u\n",
+           stats->stallUs / 1000.0, stats->ticks ? (double)stats->doutCalls / stats->ticks : 0,
+           stats->eepromWrites, stats->bankStickWrites);
+    printf("pot filter: %.2f pair updates/tick, AIN scan: %.2f conversions/tick\n",
+           stats->ticks ? (double)POTS_UpdatesGet() / stats->ticks : 0,
+           stats->ticks ? (double)stats->ainConversions / stats->ticks : 0);
+
+    u32 failed = numSysexChecks ? reportSysex() : 0;
+    if (numPotChecks)
+        failed += reportPots();
+    if (!numExpectations)
+        return failed;
+
+    printf("action lateness (wire end of the expected CC relative to its reference):\n");
+    for (x = 0; x < numExpectations; x++)
+    {
+        expectation_t *exp = &expectations[x];
+        printf("  queued %9.3f ms  %-5s ch%-2d cc%-3d ", exp->time / 1000.0, SIM_PortNameGet(exp->port),
+               (exp->status & 0x0f) + 1, exp->cc);
+        if (exp->value == NO_VALUE)
+        {
+            if (exp->matched)
+            {
+                printf("none  SENT at %9.3f ms\n", exp->done / 1000.0);
+                unexpected++;
+            }
+            else
+                printf("none  ok\n");
+            continue;
+        }
+        if (exp->value == ANY_VALUE)
+            printf("=*   ");
+        else
+            printf("=%-3d ", exp->value);
+        if (exp->reference == 0xffffffff)
+        {
+            printf("no sync point\n");
+            missing++;
+        }
+        else if (!exp->matched)
+        {
+            printf("%s %9.3f ms  NOT SENT\n", exp->synced ? "sync" : "now ", exp->reference / 1000.0);
+            missing++;
+        }
+        else
+        {
+            s32 late = (s32)(exp->done - exp->reference);
+            printf("%s %9.3f ms  wire end %9.3f ms  late %+7.3f ms\n", exp->synced ? "sync" : "now ",
+                   exp->reference / 1000.0, exp->done / 1000.0, late / 1000.0);
+            matched++;
+            sumLate += late;
+            if (late > maxLate)
+                maxLate = late;
+            if (late < minLate)
+                minLate = late;
+        }
+    }
+    if (matched)
+        printf("  summary: %u actions, lateness min %+.3f ms mean %+.3f ms max %+.3f ms",
+               matched, minLate / 1000.0, sumLate / matched / 1000.0, maxLate / 1000.0);
+    else
+        printf("  summary: no action reached the wire");
+    if (missing)
+        printf(", %u missing", missing);
+    if (unexpected)
+        printf(", %u unexpected", unexpected);
+    printf("\n");
+    return failed + missing + unexpected;
+}
+
+static void writeWireLog(const char *file)
+{
+    u32 num, i;
+    const sim_wire_byte_t *log = SIM_WireLogGet(&num);
+    FILE *f = fopen(file, "w");
+    if (!f)
+    {
+        perror(file);
+        return;
+    }
+    fprintf(f, "port,byte,queued_us,start_us,done_us\n");
+    for (i = 0; i < num; i++)
+        fprintf(f, "%s,%02X,%u,%u,%u\n", SIM_PortNameGet(log[i].port), log[i].byte,
+                log[i].queued, log[i].start, log[i].done);
+    fclose(f);
+}
+
+static void writeUsbBytes(const char *file)
+{
+    u32 num, i;
+    const sim_wire_byte_t *log = SIM_WireLogGet(&num);
+    FILE *f = fopen(file, "wb");
+    if (!f)
+    {
+        perror(file);
+        return;
+    }
+    for (i = 0; i < num; i++)
+        if (log[i].port == USB0)
+            fputc(log[i].byte, f);
+    fclose(f);
+}
+
+int main(int argc, char **argv)
+{
+    int verbose = 0;
+    const char *logFile = NULL;
+    const char *usbFile = NULL;
+    const char *script = NULL;
+    int i;
+
+    for (i = 1; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "-v"))
+            verbose = 1;
+        else if (!strcmp(argv[i], "-l") && i + 1 < argc)
+            logFile = argv[++i];
+        else if (!strcmp(argv[i], "-u") && i + 1 < argc)
+            usbFile = argv[++i];
+        else
+            script = argv[i];
+    }
+    if (!script)
+    {
+        fprintf(stderr, "usage: %s [-v] [-l wire_log.csv] [-u usb0.syx] <script>\n", argv[0]);
+        return 1;
+    }
+
+    events = malloc(MAX_EVENTS * sizeof(event_t));
+    if (!events)
+        return 1;
+
+    SIM_Init(verbose);
+    if (parseScript(script) < 0)
+        return 1;
+    SIM_Boot();
+    run();
+    u32 failed = report();
+
+    if (logFile)
+        writeWireLog(logFile);
+    if (usbFile)
+        writeUsbBytes(usbFile);
+    return failed ? 1 : 0;
+}
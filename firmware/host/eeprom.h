@@ -0,0 +1,23 @@
+/*
+ * Host-side replacement for the MIOS32 EEPROM emulation module
+ *
+ * ==========================================================================
+ *
+ *  Licensed for personal non-commercial use only.
+ *  All other rights reserved.
+ *
+ * ==========================================================================
+ */
+
+#ifndef _EEPROM_H
+#define _EEPROM_H
+
+#ifndef EEPROM_EMULATED_SIZE
+#define EEPROM_EMULATED_SIZE 128 // number of halfwords
+#endif
+
+extern s32 EEPROM_Init(u32 mode);
+extern s32 EEPROM_Read(u16 address);
+extern s32 EEPROM_Write(u16 address, u16 value);
+
+#endif /* _EEPROM_H */
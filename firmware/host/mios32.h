@@ -0,0 +1,240 @@
+/*
+ * Host-side replacement for the MIOS32 API
+ *
+ * Only the parts of MIOS32 that are used by the application are declared
+ * here. The implementation in sim_mios32.c models the hardware closely
+ * enough to benchmark the timing behaviour of app.c on a PC.
+ *
+ * ==========================================================================
+ *
+ *  Licensed for personal non-commercial use only.
+ *  All other rights reserved.
+ *
+ * ==========================================================================
+ */
+
+#ifndef _MIOS32_H
+#define _MIOS32_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// the local configuration of the application
+#include "mios32_config.h"
+
+
+/////////////////////////////////////////////////////////////////////////////
+// Global definitions
+/////////////////////////////////////////////////////////////////////////////
+
+#ifndef MIOS32_SRIO_NUM_SR
+#define MIOS32_SRIO_NUM_SR 16
+#endif
+
+#ifndef MIOS32_UART_TX_BUFFER_SIZE
+#define MIOS32_UART_TX_BUFFER_SIZE 64
+#endif
+
+#define MIOS32_UART_DEFAULT_BAUDRATE 31250
+
+#define MIOS32_IRQ_PRIO_LOWEST  15
+#define MIOS32_IRQ_PRIO_LOW     12
+#define MIOS32_IRQ_PRIO_MID      8
+#define MIOS32_IRQ_PRIO_HIGH     5
+#define MIOS32_IRQ_PRIO_HIGHEST  4
+
+#define MIOS32_TIMER_NUM 3
+
+#ifndef MIOS32_IIC_BS_NUM
+#define MIOS32_IIC_BS_NUM 0
+#endif
+
+// size of each emulated BankStick (24LC256)
+#define MIOS32_IIC_BS_SIZE 32768
+
+
+/////////////////////////////////////////////////////////////////////////////
+// Global Types
+/////////////////////////////////////////////////////////////////////////////
+
+typedef uint8_t  u8;
+typedef uint16_t u16;
+typedef uint32_t u32;
+typedef uint64_t u64;
+typedef int8_t   s8;
+typedef int16_t  s16;
+typedef int32_t  s32;
+typedef int64_t  s64;
+
+typedef enum {
+  DEFAULT = 0x00,
+  MIDI_DEBUG = 0x01,
+
+  USB0 = 0x10,
+  USB1 = 0x11,
+  USB2 = 0x12,
+  USB3 = 0x13,
+
+  UART0 = 0x20,
+  UART1 = 0x21,
+  UART2 = 0x22,
+  UART3 = 0x23,
+} mios32_midi_port_t;
+
+typedef enum {
+  Chn1,
+  Chn2,
+  Chn3,
+  Chn4,
+  Chn5,
+  Chn6,
+  Chn7,
+  Chn8,
+  Chn9,
+  Chn10,
+  Chn11,
+  Chn12,
+  Chn13,
+  Chn14,
+  Chn15,
+  Chn16
+} mios32_midi_chn_t;
+
+typedef enum {
+  NoteOff       = 0x8,
+  NoteOn        = 0x9,
+  PolyPressure  = 0xa,
+  CC            = 0xb,
+  ProgramChange = 0xc,
+  Aftertouch    = 0xd,
+  PitchBend     = 0xe
+} mios32_midi_event_t;
+
+typedef union {
+  struct {
+    u32 ALL;
+  };
+  struct {
+    u8 cin_cable;
+    u8 evnt0;
+    u8 evnt1;
+    u8 evnt2;
+  };
+  struct {
+    u8 type:4;
+    u8 cable:4;
+    u8 chn:4;
+    u8 event:4;
+    u8 value1;
+    u8 value2;
+  };
+  struct {
+    u8 cin:4;
+    u8 dummy1_cable:4;
+    u8 dummy1_chn:4;
+    u8 dummy1_event:4;
+    u8 note:8;
+    u8 velocity:8;
+  };
+  struct {
+    u8 dummy2_cin:4;
+    u8 dummy2_cable:4;
+    u8 dummy2_chn:4;
+    u8 dummy2_event:4;
+    u8 cc_number:8;
+    u8 value:8;
+  };
+} mios32_midi_package_t;
+
+
+// the parts of the CMSIS core peripherals which are used by the application
+typedef struct {
+  volatile u32 CTRL;
+  volatile u32 CYCCNT;
+} DWT_Type;
+
+typedef struct {
+  volatile u32 DEMCR;
+} CoreDebug_Type;
+
+#define DWT_CTRL_CYCCNTENA_Msk      (1UL << 0)
+#define CoreDebug_DEMCR_TRCENA_Msk  (1UL << 24)
+
+// there is only one thread of execution, a compiler barrier is sufficient
+#define __DMB() __sync_synchronize()
+
+// Cortex-M4 SIMD instructions (CMSIS)
+#define __CORTEX_M 4
+
+static inline u32 __SHADD16(u32 a, u32 b)
+{
+    s32 lo = ((s32)(s16)(a & 0xffff) + (s32)(s16)(b & 0xffff)) >> 1;
+    s32 hi = ((s32)(s16)(a >> 16) + (s32)(s16)(b >> 16)) >> 1;
+    return ((u32)hi << 16) | ((u32)lo & 0xffff);
+}
+
+static inline u32 __PKHBT(u32 a, u32 b, u32 shift)
+{
+    return (a & 0x0000ffff) | ((b << shift) & 0xffff0000);
+}
+
+// the cycle counter follows the simulated time
+#define DWT       (SIM_DWT())
+#define CoreDebug (&SIM_CoreDebug)
+
+
+/////////////////////////////////////////////////////////////////////////////
+// Prototypes
+/////////////////////////////////////////////////////////////////////////////
+
+extern DWT_Type *SIM_DWT(void);
+extern CoreDebug_Type SIM_CoreDebug;
+extern u32 SystemCoreClock;
+
+extern s32 MIOS32_IRQ_Disable(void);
+extern s32 MIOS32_IRQ_Enable(void);
+
+extern s32 MIOS32_TIMER_Init(u8 timer, u32 period, void *_irq_handler, u8 irq_priority);
+extern s32 MIOS32_TIMER_ReInit(u8 timer, u32 period);
+extern s32 MIOS32_TIMER_DeInit(u8 timer);
+
+extern s32 MIOS32_BOARD_LED_Init(u32 leds);
+extern s32 MIOS32_BOARD_LED_Set(u32 leds, u32 value);
+
+extern s32 MIOS32_DOUT_PinSet(u32 pin, u32 value);
+extern s32 MIOS32_DOUT_PinGet(u32 pin);
+extern s32 MIOS32_DOUT_SRSet(u32 sr, u8 value);
+extern s32 MIOS32_DOUT_SRGet(u32 sr);
+
+extern s32 MIOS32_DIN_PinGet(u32 pin);
+
+extern s32 MIOS32_AIN_PinGet(u32 pin);
+
+extern s32 MIOS32_IIC_BS_Init(u32 mode);
+extern s32 MIOS32_IIC_BS_CheckAvailable(u8 bs);
+extern s32 MIOS32_IIC_BS_Read(u8 bs, u16 address, u8 *buffer, u16 len);
+extern s32 MIOS32_IIC_BS_Write(u8 bs, u16 address, u8 *buffer, u16 len);
+extern s32 MIOS32_IIC_BS_CheckWriteFinished(u8 bs);
+
+extern s32 MIOS32_UART_TxBufferFree(u8 uart);
+extern s32 MIOS32_UART_TxBufferUsed(u8 uart);
+extern s32 MIOS32_UART_TxBufferPut(u8 uart, u8 b);
+extern s32 MIOS32_UART_TxBufferPutMore(u8 uart, u8 *buffer, u16 len);
+extern s32 MIOS32_UART_TxBufferPut_NonBlocking(u8 uart, u8 b);
+extern s32 MIOS32_UART_TxBufferPutMore_NonBlocking(u8 uart, u8 *buffer, u16 len);
+
+extern s32 MIOS32_MIDI_SendPackage(mios32_midi_port_t port, mios32_midi_package_t package);
+extern s32 MIOS32_MIDI_SendEvent(mios32_midi_port_t port, u8 evnt0, u8 evnt1, u8 evnt2);
+extern s32 MIOS32_MIDI_SendNoteOff(mios32_midi_port_t port, mios32_midi_chn_t chn, u8 note, u8 vel);
+extern s32 MIOS32_MIDI_SendNoteOn(mios32_midi_port_t port, mios32_midi_chn_t chn, u8 note, u8 vel);
+extern s32 MIOS32_MIDI_SendCC(mios32_midi_port_t port, mios32_midi_chn_t chn, u8 cc, u8 val);
+extern s32 MIOS32_MIDI_SendProgramChange(mios32_midi_port_t port, mios32_midi_chn_t chn, u8 prg);
+extern s32 MIOS32_MIDI_SendClock(mios32_midi_port_t port);
+extern s32 MIOS32_MIDI_SendStart(mios32_midi_port_t port);
+extern s32 MIOS32_MIDI_SendContinue(mios32_midi_port_t port);
+extern s32 MIOS32_MIDI_SendStop(mios32_midi_port_t port);
+extern s32 MIOS32_MIDI_SendSysEx(mios32_midi_port_t port, u8 *stream, u32 count);
+extern s32 MIOS32_MIDI_SendDebugMessage(const char *format, ...);
+extern s32 MIOS32_MIDI_DirectRxCallback_Init(s32 (*callback_rx)(mios32_midi_port_t port, u8 midi_byte));
+
+#endif /* _MIOS32_H */
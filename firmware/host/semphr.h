@@ -0,0 +1,31 @@
+/*
+ * Host-side replacement for the FreeRTOS semaphore API
+ *
+ * ==========================================================================
+ *
+ *  Licensed for personal non-commercial use only.
+ *  All other rights reserved.
+ *
+ * ==========================================================================
+ */
+
+#ifndef _SEMPHR_H
+#define _SEMPHR_H
+
+
+/////////////////////////////////////////////////////////////////////////////
+// Global Types
+/////////////////////////////////////////////////////////////////////////////
+
+typedef void *xSemaphoreHandle;
+
+
+/////////////////////////////////////////////////////////////////////////////
+// Prototypes
+/////////////////////////////////////////////////////////////////////////////
+
+extern xSemaphoreHandle xSemaphoreCreateRecursiveMutex(void);
+extern portBASE_TYPE xSemaphoreTakeRecursive(xSemaphoreHandle xMutex, portTickType xBlockTime);
+extern portBASE_TYPE xSemaphoreGiveRecursive(xSemaphoreHandle xMutex);
+
+#endif /* _SEMPHR_H */
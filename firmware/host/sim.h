@@ -0,0 +1,76 @@
+/*
+ * Header file of the host simulation engine
+ *
+ * The engine owns the simulated time base (in uS), calls the application
+ * hooks the way the MIOS32 programming model does and records every byte
+ * which is sent to a MIDI port together with its timestamps.
+ *
+ * ==========================================================================
+ *
+ *  Licensed for personal non-commercial use only.
+ *  All other rights reserved.
+ *
+ * ==========================================================================
+ */
+
+#ifndef _SIM_H
+#define _SIM_H
+
+
+/////////////////////////////////////////////////////////////////////////////
+// Global definitions
+/////////////////////////////////////////////////////////////////////////////
+
+// wire time of one byte at 31250 baud (1 start, 8 data, 1 stop bit)
+#define SIM_UART_BYTE_US 320
+
+
+/////////////////////////////////////////////////////////////////////////////
+// Global Types
+/////////////////////////////////////////////////////////////////////////////
+
+typedef struct
+{
+    mios32_midi_port_t port;
+    u8 byte;
+    u32 queued; // time the application handed the byte to the driver
+    u32 start;  // time the first bit has been put onto the wire
+    u32 done;   // time the last bit has left the wire
+} sim_wire_byte_t;
+
+typedef struct
+{
+    u32 ticks;          // number of 1 mS ticks processed
+    u32 stallUs;        // time spent in blocking sends on a full UART buffer
+    u32 debugMessages;
+    u32 doutCalls;      // MIOS32_DOUT_* calls
+    u32 eepromWrites;
+    u32 bankStickWrites;
+    u32 ainConversions; // conversion results of the AIN scan
+} sim_stats_t;
+
+
+/////////////////////////////////////////////////////////////////////////////
+// Prototypes
+/////////////////////////////////////////////////////////////////////////////
+
+extern void SIM_Init(int verbose);
+extern void SIM_Boot(void);
+extern u32  SIM_TimeGet(void);
+extern void SIM_RunUntil(u32 time_us);
+
+extern void SIM_MIDI_Receive(mios32_midi_port_t port, const u8 *bytes, u32 len);
+extern void SIM_DIN_Set(u32 pin, u32 value);
+extern void SIM_AIN_Set(u32 pin, u32 value);
+extern void SIM_AIN_NoiseSet(u32 amplitude);
+extern u8   SIM_DOUT_Get(u32 pin);
+
+// sim_freertos.c
+extern void SIM_TASK_Init(void);
+extern void SIM_TASK_Run(u32 tick);
+
+extern const sim_wire_byte_t *SIM_WireLogGet(u32 *num);
+extern const sim_stats_t *SIM_StatsGet(void);
+extern const char *SIM_PortNameGet(mios32_midi_port_t port);
+
+#endif /* _SIM_H */
@@ -0,0 +1,154 @@
+/* Host-side implementation of the FreeRTOS functions used by the application.
+
+   Tasks run cooperatively on their own stack (ucontext). The simulation
+   engine resumes each task once per mS tick after the MIOS32 hooks, if its
+   wake time has been reached. A task gives control back to the engine when
+   it calls vTaskDelay or vTaskDelayUntil. As nothing is preempted, mutexes
+   are always available and only count the recursion depth.
+*/
+
+/////////////////////////////////////////////////////////////////////////////
+// Include files
+/////////////////////////////////////////////////////////////////////////////
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <ucontext.h>
+
+#include <FreeRTOS.h>
+#include <task.h>
+#include <semphr.h>
+#include "sim.h"
+
+#define SIM_MAX_TASKS       4
+#define SIM_MAX_MUTEXES     4
+#define SIM_TASK_STACK_SIZE (64 * 1024)
+
+typedef struct
+{
+    ucontext_t context;
+    void *stack;
+    pdTASK_CODE code;
+    void *parameters;
+    portTickType wakeTick;
+} sim_task_t;
+
+static sim_task_t tasks[SIM_MAX_TASKS];
+static int numTasks;
+static sim_task_t *currentTask;
+static ucontext_t engineContext;
+static portTickType tickCount;
+
+static int mutexDepth[SIM_MAX_MUTEXES];
+static int numMutexes;
+
+/////////////////////////////////////////////////////////////////////////////
+// Engine
+/////////////////////////////////////////////////////////////////////////////
+
+void SIM_TASK_Init(void)
+{
+    int i;
+    for (i = 0; i < numTasks; i++)
+        free(tasks[i].stack);
+    numTasks = 0;
+    numMutexes = 0;
+    currentTask = NULL;
+    tickCount = 0;
+}
+
+static void taskEntry(void)
+{
+    currentTask->code(currentTask->parameters);
+    // FreeRTOS tasks must never return
+    fprintf(stderr, "sim: task returned\n");
+    exit(1);
+}
+
+void SIM_TASK_Run(u32 tick)
+{
+    int i;
+    tickCount = tick;
+    for (i = 0; i < numTasks; i++)
+    {
+        if ((s32)(tasks[i].wakeTick - tick) > 0)
+            continue;
+        currentTask = &tasks[i];
+        swapcontext(&engineContext, &tasks[i].context);
+        currentTask = NULL;
+    }
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// Tasks
+/////////////////////////////////////////////////////////////////////////////
+
+portBASE_TYPE xTaskCreate(pdTASK_CODE pvTaskCode, const signed portCHAR *pcName,
+                          unsigned short usStackDepth, void *pvParameters,
+                          unsigned portBASE_TYPE uxPriority, xTaskHandle *pxCreatedTask)
+{
+    if (numTasks >= SIM_MAX_TASKS)
+        return pdFALSE;
+
+    sim_task_t *t = &tasks[numTasks++];
+    t->code = pvTaskCode;
+    t->parameters = pvParameters;
+    t->wakeTick = tickCount;
+    t->stack = malloc(SIM_TASK_STACK_SIZE);
+    getcontext(&t->context);
+    t->context.uc_stack.ss_sp = t->stack;
+    t->context.uc_stack.ss_size = SIM_TASK_STACK_SIZE;
+    t->context.uc_link = NULL;
+    makecontext(&t->context, taskEntry, 0);
+
+    if (pxCreatedTask)
+        *pxCreatedTask = t;
+    return pdPASS;
+}
+
+portTickType xTaskGetTickCount(void)
+{
+    return tickCount;
+}
+
+void vTaskDelayUntil(portTickType *pxPreviousWakeTime, portTickType xTimeIncrement)
+{
+    *pxPreviousWakeTime += xTimeIncrement;
+    if (!currentTask)
+        return;
+    currentTask->wakeTick = *pxPreviousWakeTime;
+    swapcontext(&currentTask->context, &engineContext);
+}
+
+void vTaskDelay(portTickType xTicksToDelay)
+{
+    portTickType wakeTime = tickCount;
+    vTaskDelayUntil(&wakeTime, xTicksToDelay ? xTicksToDelay : 1);
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// Semaphores
+/////////////////////////////////////////////////////////////////////////////
+
+xSemaphoreHandle xSemaphoreCreateRecursiveMutex(void)
+{
+    if (numMutexes >= SIM_MAX_MUTEXES)
+        return NULL;
+    mutexDepth[numMutexes] = 0;
+    return &mutexDepth[numMutexes++];
+}
+
+portBASE_TYPE xSemaphoreTakeRecursive(xSemaphoreHandle xMutex, portTickType xBlockTime)
+{
+    (*(int *)xMutex)++;
+    return pdTRUE;
+}
+
+portBASE_TYPE xSemaphoreGiveRecursive(xSemaphoreHandle xMutex)
+{
+    int *depth = (int *)xMutex;
+    if (*depth <= 0)
+        return pdFALSE;
+    (*depth)--;
+    return pdTRUE;
+}
@@ -0,0 +1,800 @@
+/* Host-side implementation of the MIOS32 functions used by the application.
+
+   Time is simulated in uS. SIM_RunUntil() advances it and calls the hooks
+   of the traditional programming model once per mS, in the same order as
+   the MIOS32 tasks would (timer interrupts are called in between at their
+   exact time):
+        APP_SRIO_ServicePrepare / APP_SRIO_ServiceFinish (SRIO scan)
+        APP_Tick                                         (main task)
+        APP_MIDI_Tick                                    (MIDI task)
+        tasks created by the application                 (see sim_freertos.c)
+        APP_Background
+
+   The two UARTs are modelled at 31250 baud with a MIOS32_UART_TX_BUFFER_SIZE
+   byte transmit buffer. Blocking sends on a full buffer advance the
+   simulated time (the CPU would spin there) and are accounted as stall
+   time. Every byte which leaves a MIDI port is logged with the time it was
+   queued, the time it went onto the wire and the time it was complete.
+   USB is modelled without transfer delay.
+*/
+
+/////////////////////////////////////////////////////////////////////////////
+// Include files
+/////////////////////////////////////////////////////////////////////////////
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+
+#include <mios32.h>
+#include <eeprom.h>
+#include "app.h"
+#include "sim.h"
+
+#define SIM_NUM_UARTS 2
+#define SIM_NUM_PINS  (8 * MIOS32_SRIO_NUM_SR)
+
+typedef struct
+{
+    u32 busyUntil;  // wire end of the last queued byte
+    u32 startTimes[MIOS32_UART_TX_BUFFER_SIZE];
+    u32 head;       // oldest byte which may still wait in the buffer
+    u32 tail;
+} sim_uart_t;
+
+typedef struct
+{
+    void (*handler)(void);
+    u32 period;     // 0 == timer not running
+    u32 next;       // time of the next interrupt
+} sim_timer_t;
+
+typedef struct
+{
+    u8 runningStatus;
+    u8 expected;
+    u8 num;
+    u8 bytes[3];
+    u8 inSysex;
+} sim_rx_parser_t;
+
+static int verboseOutput;
+static int booted;
+static u32 simTime;
+static u32 nextTick;
+static sim_stats_t stats;
+
+static sim_uart_t uarts[SIM_NUM_UARTS];
+static sim_timer_t timers[MIOS32_TIMER_NUM];
+static sim_rx_parser_t rxParsers[3];
+
+static sim_wire_byte_t *wireLog;
+static u32 wireLogNum;
+static u32 wireLogSize;
+
+static u8 doutSR[MIOS32_SRIO_NUM_SR];
+static u8 dinPins[SIM_NUM_PINS];
+static u16 ainPins[16];      // pot positions
+static u16 ainConverted[16]; // last conversion results
+static u16 ainReported[16];
+static u8 ainMuxStep;       // multiplexer position converted next
+static u32 ainNoise;        // max. deviation of a conversion result from the pot value
+static u32 ainNoiseSeed = 1;
+static s32 eepromData[EEPROM_EMULATED_SIZE];
+static u8 bankStickData[MIOS32_IIC_BS_NUM ? MIOS32_IIC_BS_NUM : 1][MIOS32_IIC_BS_SIZE];
+// a page write takes 5 mS, the EEPROM doesn't answer meanwhile
+#define BANKSTICK_WRITE_TIME 5000
+static u32 bankStickWriteEnd[MIOS32_IIC_BS_NUM ? MIOS32_IIC_BS_NUM : 1];
+
+static s32 (*directRxCallback)(mios32_midi_port_t port, u8 midi_byte);
+
+static u16 convertAin(u32 pin);
+static void scanAin(void);
+
+static DWT_Type dwt;
+CoreDebug_Type SIM_CoreDebug;
+u32 SystemCoreClock = 168000000;
+
+/////////////////////////////////////////////////////////////////////////////
+// Engine
+/////////////////////////////////////////////////////////////////////////////
+
+void SIM_Init(int verbose)
+{
+    int i;
+    verboseOutput = verbose;
+    booted = 0;
+    simTime = 0;
+    nextTick = 1000;
+    memset(&stats, 0, sizeof(stats));
+    memset(uarts, 0, sizeof(uarts));
+    memset(timers, 0, sizeof(timers));
+    memset(rxParsers, 0, sizeof(rxParsers));
+    memset(doutSR, 0, sizeof(doutSR));
+    memset(ainReported, 0, sizeof(ainReported));
+    ainMuxStep = 0;
+    wireLogNum = 0;
+    directRxCallback = NULL;
+    SIM_TASK_Init();
+
+    // buttons are active low
+    for (i = 0; i < SIM_NUM_PINS; i++)
+        dinPins[i] = 1;
+    // the emulated EEPROM starts out unprogrammed
+    for (i = 0; i < EEPROM_EMULATED_SIZE; i++)
+        eepromData[i] = -1;
+    // so do the BankSticks
+    memset(bankStickData, 0xff, sizeof(bankStickData));
+    memset(bankStickWriteEnd, 0, sizeof(bankStickWriteEnd));
+}
+
+void SIM_Boot(void)
+{
+    int i;
+    // MIOS32_AIN_Init() converts all pins once
+    for (i = 0; i < 16; i++)
+    {
+        ainConverted[i] = convertAin(i);
+        ainReported[i] = ainConverted[i];
+    }
+    booted = 1;
+    APP_Init();
+}
+
+u32 SIM_TimeGet(void)
+{
+    return simTime;
+}
+
+void SIM_RunUntil(u32 time_us)
+{
+    while (1)
+    {
+        u32 next = nextTick;
+        sim_timer_t *timer = NULL;
+        int i;
+        for (i = 0; i < MIOS32_TIMER_NUM; i++)
+        {
+            if (timers[i].period && ((s32)(timers[i].next - next) < 0))
+            {
+                next = timers[i].next;
+                timer = &timers[i];
+            }
+        }
+        if ((s32)(next - time_us) > 0)
+            break;
+
+        if ((s32)(next - simTime) > 0)
+            simTime = next;
+
+        if (timer)
+        {
+            timer->next += timer->period;
+            timer->handler();
+            continue;
+        }
+
+        nextTick += 1000;
+        stats.ticks++;
+
+        scanAin();
+        APP_SRIO_ServicePrepare();
+        APP_SRIO_ServiceFinish();
+        APP_Tick();
+        APP_MIDI_Tick();
+        SIM_TASK_Run(stats.ticks);
+        APP_Background();
+    }
+    if ((s32)(time_us - simTime) > 0)
+        simTime = time_us;
+}
+
+const sim_wire_byte_t *SIM_WireLogGet(u32 *num)
+{
+    *num = wireLogNum;
+    return wireLog;
+}
+
+const sim_stats_t *SIM_StatsGet(void)
+{
+    return &stats;
+}
+
+const char *SIM_PortNameGet(mios32_midi_port_t port)
+{
+    switch (port)
+    {
+        case USB0:  return "USB0";
+        case UART0: return "UART0";
+        case UART1: return "UART1";
+        default:    return "???";
+    }
+}
+
+static void logWireByte(mios32_midi_port_t port, u8 byte, u32 start, u32 done)
+{
+    if (wireLogNum >= wireLogSize)
+    {
+        wireLogSize = wireLogSize ? 2 * wireLogSize : 4096;
+        wireLog = realloc(wireLog, wireLogSize * sizeof(sim_wire_byte_t));
+        if (!wireLog)
+        {
+            fprintf(stderr, "out of memory\n");
+            exit(1);
+        }
+    }
+    wireLog[wireLogNum].port = port;
+    wireLog[wireLogNum].byte = byte;
+    wireLog[wireLogNum].queued = simTime;
+    wireLog[wireLogNum].start = start;
+    wireLog[wireLogNum].done = done;
+    wireLogNum++;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// Core peripherals
+/////////////////////////////////////////////////////////////////////////////
+
+DWT_Type *SIM_DWT(void)
+{
+    dwt.CYCCNT = simTime * (SystemCoreClock / 1000000);
+    return &dwt;
+}
+
+s32 MIOS32_TIMER_Init(u8 timer, u32 period, void *_irq_handler, u8 irq_priority)
+{
+    if ((timer >= MIOS32_TIMER_NUM) || !period)
+        return -1;
+    timers[timer].handler = _irq_handler;
+    // 16 bit auto-reload register, counting in uS like on the STM32
+    timers[timer].period = ((period - 1) & 0xffff) + 1;
+    timers[timer].next = simTime + period;
+    return 0;
+}
+
+s32 MIOS32_TIMER_ReInit(u8 timer, u32 period)
+{
+    if ((timer >= MIOS32_TIMER_NUM) || !timers[timer].handler || !period)
+        return -1;
+    timers[timer].period = ((period - 1) & 0xffff) + 1;
+    return 0;
+}
+
+s32 MIOS32_TIMER_DeInit(u8 timer)
+{
+    if (timer >= MIOS32_TIMER_NUM)
+        return -1;
+    timers[timer].period = 0;
+    return 0;
+}
+
+s32 MIOS32_IRQ_Disable(void)
+{
+    return 0;
+}
+
+s32 MIOS32_IRQ_Enable(void)
+{
+    return 0;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// MIDI input
+/////////////////////////////////////////////////////////////////////////////
+
+static void notifyPackage(mios32_midi_port_t port, u8 type, u8 evnt0, u8 evnt1, u8 evnt2)
+{
+    mios32_midi_package_t p;
+    p.ALL = 0;
+    p.type = type;
+    p.evnt0 = evnt0;
+    p.evnt1 = evnt1;
+    p.evnt2 = evnt2;
+    APP_MIDI_NotifyPackage(port, p);
+}
+
+static void parseRxByte(mios32_midi_port_t port, sim_rx_parser_t *rx, u8 b)
+{
+    if (b >= 0xf8)
+    {
+        notifyPackage(port, 0xf, b, 0, 0);
+    }
+    else if (b == 0xf0)
+    {
+        rx->inSysex = 1;
+        rx->runningStatus = 0;
+        rx->bytes[0] = b;
+        rx->num = 1;
+    }
+    else if (b == 0xf7)
+    {
+        if (rx->inSysex)
+        {
+            rx->bytes[rx->num++] = b;
+            notifyPackage(port, 0x4 + rx->num, rx->bytes[0],
+                          rx->num > 1 ? rx->bytes[1] : 0, rx->num > 2 ? rx->bytes[2] : 0);
+        }
+        rx->inSysex = 0;
+        rx->num = 0;
+    }
+    else if (b >= 0x80)
+    {
+        rx->inSysex = 0;
+        rx->bytes[0] = b;
+        rx->num = 1;
+        if (b >= 0xf0)
+        {
+            // system common messages cancel the running status
+            rx->runningStatus = 0;
+            rx->expected = (b == 0xf2) ? 2 : ((b == 0xf1) || (b == 0xf3)) ? 1 : 0;
+            if (!rx->expected)
+            {
+                notifyPackage(port, 0x5, b, 0, 0);
+                rx->num = 0;
+            }
+        }
+        else
+        {
+            rx->runningStatus = b;
+            rx->expected = ((b & 0xf0) == 0xc0 || (b & 0xf0) == 0xd0) ? 1 : 2;
+        }
+    }
+    else if (rx->inSysex)
+    {
+        rx->bytes[rx->num++] = b;
+        if (rx->num == 3)
+        {
+            notifyPackage(port, 0x4, rx->bytes[0], rx->bytes[1], rx->bytes[2]);
+            rx->num = 0;
+        }
+    }
+    else
+    {
+        if (rx->num == 0)
+        {
+            if (!rx->runningStatus)
+                return; // stray data byte
+            rx->bytes[0] = rx->runningStatus;
+            rx->num = 1;
+        }
+        rx->bytes[rx->num++] = b;
+        if (rx->num > rx->expected)
+        {
+            u8 status = rx->bytes[0];
+            u8 type = (status < 0xf0) ? (status >> 4) : (rx->expected == 2) ? 0x3 : 0x2;
+            notifyPackage(port, type, status, rx->bytes[1], rx->expected == 2 ? rx->bytes[2] : 0);
+            rx->num = 0;
+        }
+    }
+}
+
+void SIM_MIDI_Receive(mios32_midi_port_t port, const u8 *bytes, u32 len)
+{
+    sim_rx_parser_t *rx = &rxParsers[(port == USB0) ? 0 : (port == UART0) ? 1 : 2];
+    u32 i;
+    for (i = 0; i < len; i++)
+    {
+        if (directRxCallback)
+            directRxCallback(port, bytes[i]);
+        parseRxByte(port, rx, bytes[i]);
+    }
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// Buttons, pots, LEDs
+/////////////////////////////////////////////////////////////////////////////
+
+void SIM_DIN_Set(u32 pin, u32 value)
+{
+    if (pin >= SIM_NUM_PINS || dinPins[pin] == value)
+        return;
+    dinPins[pin] = value;
+    APP_DIN_NotifyToggle(pin, value);
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// returns a conversion result of a pin, it deviates uniformly from the pot
+// value by up to the noise amplitude
+/////////////////////////////////////////////////////////////////////////////
+static u16 convertAin(u32 pin)
+{
+    if (!ainNoise)
+        return ainPins[pin];
+
+    ainNoiseSeed = ainNoiseSeed * 1103515245 + 12345;
+    s32 value = (s32)ainPins[pin] + (s32)((ainNoiseSeed >> 16) % (2 * ainNoise + 1)) - (s32)ainNoise;
+    return (value < 0) ? 0 : (value > 4095) ? 4095 : value;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// the AIN scan of MIOS32, started each mS: both ADC channels are converted
+// at one position of the 74HC4051 multiplexers (pins 0..7 on the first
+// channel, 8..15 on the second), then the multiplexers step on. Each pin
+// gets a new conversion result every 8 mS, MIOS32_AIN_PinGet() returns the
+// last one.
+/////////////////////////////////////////////////////////////////////////////
+static void scanAin(void)
+{
+    u32 pin;
+    for (pin = ainMuxStep; pin < 16; pin += 8)
+    {
+        ainConverted[pin] = convertAin(pin);
+        stats.ainConversions++;
+        if (abs((int)ainConverted[pin] - (int)ainReported[pin]) > MIOS32_AIN_DEADBAND)
+        {
+            ainReported[pin] = ainConverted[pin];
+            APP_AIN_NotifyChange(pin, ainConverted[pin]);
+        }
+    }
+    ainMuxStep = (ainMuxStep + 1) & 7;
+}
+
+void SIM_AIN_Set(u32 pin, u32 value)
+{
+    if (pin >= 16)
+        return;
+    ainPins[pin] = value;
+}
+
+void SIM_AIN_NoiseSet(u32 amplitude)
+{
+    ainNoise = amplitude;
+}
+
+u8 SIM_DOUT_Get(u32 pin)
+{
+    return (doutSR[pin >> 3] >> (pin & 7)) & 1;
+}
+
+s32 MIOS32_BOARD_LED_Init(u32 leds)
+{
+    return 0;
+}
+
+s32 MIOS32_BOARD_LED_Set(u32 leds, u32 value)
+{
+    return 0;
+}
+
+s32 MIOS32_DOUT_PinSet(u32 pin, u32 value)
+{
+    stats.doutCalls++;
+    if (pin >= SIM_NUM_PINS)
+        return -1;
+    if (value)
+        doutSR[pin >> 3] |= (1 << (pin & 7));
+    else
+        doutSR[pin >> 3] &= ~(1 << (pin & 7));
+    return 0;
+}
+
+s32 MIOS32_DOUT_PinGet(u32 pin)
+{
+    if (pin >= SIM_NUM_PINS)
+        return -1;
+    return SIM_DOUT_Get(pin);
+}
+
+s32 MIOS32_DOUT_SRSet(u32 sr, u8 value)
+{
+    stats.doutCalls++;
+    if (sr >= MIOS32_SRIO_NUM_SR)
+        return -1;
+    doutSR[sr] = value;
+    return 0;
+}
+
+s32 MIOS32_DOUT_SRGet(u32 sr)
+{
+    if (sr >= MIOS32_SRIO_NUM_SR)
+        return -1;
+    return doutSR[sr];
+}
+
+s32 MIOS32_DIN_PinGet(u32 pin)
+{
+    if (pin >= SIM_NUM_PINS)
+        return -1;
+    return dinPins[pin];
+}
+
+s32 MIOS32_AIN_PinGet(u32 pin)
+{
+    if (pin >= 16)
+        return -1;
+    return ainConverted[pin];
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// EEPROM emulation
+/////////////////////////////////////////////////////////////////////////////
+
+s32 EEPROM_Init(u32 mode)
+{
+    return 0;
+}
+
+s32 EEPROM_Read(u16 address)
+{
+    if (address >= EEPROM_EMULATED_SIZE)
+        return -2;
+    return eepromData[address]; // -1 if not programmed yet
+}
+
+s32 EEPROM_Write(u16 address, u16 value)
+{
+    if (address >= EEPROM_EMULATED_SIZE)
+        return -2;
+    stats.eepromWrites++;
+    eepromData[address] = value;
+    return 0;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// BankStick
+/////////////////////////////////////////////////////////////////////////////
+
+static u8 bankStickBusy(u8 bs)
+{
+    return (s32)(bankStickWriteEnd[bs] - simTime) > 0;
+}
+
+s32 MIOS32_IIC_BS_Init(u32 mode)
+{
+    return 0;
+}
+
+s32 MIOS32_IIC_BS_CheckAvailable(u8 bs)
+{
+    return (bs < MIOS32_IIC_BS_NUM) ? MIOS32_IIC_BS_SIZE : 0;
+}
+
+s32 MIOS32_IIC_BS_Read(u8 bs, u16 address, u8 *buffer, u16 len)
+{
+    if ((bs >= MIOS32_IIC_BS_NUM) || ((u32)address + len > MIOS32_IIC_BS_SIZE) || bankStickBusy(bs))
+        return -1;
+    memcpy(buffer, &bankStickData[bs][address], len);
+    return 0;
+}
+
+s32 MIOS32_IIC_BS_Write(u8 bs, u16 address, u8 *buffer, u16 len)
+{
+    // a write must stay within one 64 byte page
+    if ((bs >= MIOS32_IIC_BS_NUM) || (len > 64) || ((address & 0x3f) + len > 64)
+        || ((u32)address + len > MIOS32_IIC_BS_SIZE) || bankStickBusy(bs))
+        return -1;
+    stats.bankStickWrites++;
+    bankStickWriteEnd[bs] = simTime + BANKSTICK_WRITE_TIME;
+    memcpy(&bankStickData[bs][address], buffer, len);
+    return 0;
+}
+
+s32 MIOS32_IIC_BS_CheckWriteFinished(u8 bs)
+{
+    if (bs >= MIOS32_IIC_BS_NUM)
+        return -1;
+    return bankStickBusy(bs) ? 1 : 0;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// UART
+/////////////////////////////////////////////////////////////////////////////
+
+static u32 uartBufferUsed(sim_uart_t *u)
+{
+    // bytes leave the buffer as soon as they are moved into the shift register
+    while (u->head != u->tail && (s32)(u->startTimes[u->head % MIOS32_UART_TX_BUFFER_SIZE] - simTime) <= 0)
+        u->head++;
+    return u->tail - u->head;
+}
+
+static void uartPut(u8 uart, u8 b)
+{
+    sim_uart_t *u = &uarts[uart];
+    u32 start = ((s32)(u->busyUntil - simTime) > 0) ? u->busyUntil : simTime;
+    u32 done = start + SIM_UART_BYTE_US;
+    if (start != simTime)
+        u->startTimes[u->tail++ % MIOS32_UART_TX_BUFFER_SIZE] = start;
+    u->busyUntil = done;
+    logWireByte(UART0 + uart, b, start, done);
+}
+
+s32 MIOS32_UART_TxBufferFree(u8 uart)
+{
+    if (uart >= SIM_NUM_UARTS)
+        return 0;
+    return MIOS32_UART_TX_BUFFER_SIZE - uartBufferUsed(&uarts[uart]);
+}
+
+s32 MIOS32_UART_TxBufferUsed(u8 uart)
+{
+    if (uart >= SIM_NUM_UARTS)
+        return 0;
+    return uartBufferUsed(&uarts[uart]);
+}
+
+s32 MIOS32_UART_TxBufferPut_NonBlocking(u8 uart, u8 b)
+{
+    if (uart >= SIM_NUM_UARTS)
+        return -1;
+    if (uartBufferUsed(&uarts[uart]) >= MIOS32_UART_TX_BUFFER_SIZE)
+        return -2;
+    uartPut(uart, b);
+    return 0;
+}
+
+s32 MIOS32_UART_TxBufferPutMore_NonBlocking(u8 uart, u8 *buffer, u16 len)
+{
+    u16 i;
+    if (uart >= SIM_NUM_UARTS)
+        return -1;
+    if (uartBufferUsed(&uarts[uart]) + len > MIOS32_UART_TX_BUFFER_SIZE)
+        return -2;
+    for (i = 0; i < len; i++)
+        uartPut(uart, buffer[i]);
+    return 0;
+}
+
+// blocking variant, used by the MIDI layer: spins until there is room
+static void uartPutBlocking(u8 uart, u8 b)
+{
+    sim_uart_t *u = &uarts[uart];
+    if (uartBufferUsed(u) >= MIOS32_UART_TX_BUFFER_SIZE)
+    {
+        u32 freeAt = u->startTimes[u->head % MIOS32_UART_TX_BUFFER_SIZE];
+        stats.stallUs += freeAt - simTime;
+        simTime = freeAt;
+        uartBufferUsed(u);
+    }
+    uartPut(uart, b);
+}
+
+// the blocking variants spin until there is room, like on the hardware
+s32 MIOS32_UART_TxBufferPut(u8 uart, u8 b)
+{
+    if (uart >= SIM_NUM_UARTS)
+        return -1;
+    uartPutBlocking(uart, b);
+    return 0;
+}
+
+s32 MIOS32_UART_TxBufferPutMore(u8 uart, u8 *buffer, u16 len)
+{
+    u16 i;
+    if (uart >= SIM_NUM_UARTS)
+        return -1;
+    for (i = 0; i < len; i++)
+        uartPutBlocking(uart, buffer[i]);
+    return 0;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// MIDI output
+/////////////////////////////////////////////////////////////////////////////
+
+static u8 packageLength(mios32_midi_package_t package)
+{
+    switch (package.type)
+    {
+        case 0x2: case 0x6: case 0xc: case 0xd:
+            return 2;
+        case 0x3: case 0x4: case 0x7: case 0x8: case 0x9: case 0xa: case 0xb: case 0xe:
+            return 3;
+        case 0x5: case 0xf:
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+s32 MIOS32_MIDI_SendPackage(mios32_midi_port_t port, mios32_midi_package_t package)
+{
+    u8 bytes[3] = { package.evnt0, package.evnt1, package.evnt2 };
+    u8 len = packageLength(package);
+    u8 i;
+
+    if (port == USB0)
+    {
+        for (i = 0; i < len; i++)
+            logWireByte(port, bytes[i], simTime, simTime);
+        return 0;
+    }
+    if (port == UART0 || port == UART1)
+    {
+        for (i = 0; i < len; i++)
+            uartPutBlocking(port - UART0, bytes[i]);
+        return 0;
+    }
+    return -1;
+}
+
+s32 MIOS32_MIDI_SendEvent(mios32_midi_port_t port, u8 evnt0, u8 evnt1, u8 evnt2)
+{
+    mios32_midi_package_t package;
+    package.ALL = 0;
+    package.type = evnt0 >> 4;
+    package.evnt0 = evnt0;
+    package.evnt1 = evnt1;
+    package.evnt2 = evnt2;
+    return MIOS32_MIDI_SendPackage(port, package);
+}
+
+s32 MIOS32_MIDI_SendNoteOff(mios32_midi_port_t port, mios32_midi_chn_t chn, u8 note, u8 vel)
+{
+    return MIOS32_MIDI_SendEvent(port, 0x80 | chn, note, vel);
+}
+
+s32 MIOS32_MIDI_SendNoteOn(mios32_midi_port_t port, mios32_midi_chn_t chn, u8 note, u8 vel)
+{
+    return MIOS32_MIDI_SendEvent(port, 0x90 | chn, note, vel);
+}
+
+s32 MIOS32_MIDI_SendCC(mios32_midi_port_t port, mios32_midi_chn_t chn, u8 cc, u8 val)
+{
+    return MIOS32_MIDI_SendEvent(port, 0xb0 | chn, cc, val);
+}
+
+s32 MIOS32_MIDI_SendProgramChange(mios32_midi_port_t port, mios32_midi_chn_t chn, u8 prg)
+{
+    return MIOS32_MIDI_SendEvent(port, 0xc0 | chn, prg, 0x00);
+}
+
+s32 MIOS32_MIDI_SendClock(mios32_midi_port_t port)
+{
+    return MIOS32_MIDI_SendEvent(port, 0xf8, 0x00, 0x00);
+}
+
+s32 MIOS32_MIDI_SendStart(mios32_midi_port_t port)
+{
+    return MIOS32_MIDI_SendEvent(port, 0xfa, 0x00, 0x00);
+}
+
+s32 MIOS32_MIDI_SendContinue(mios32_midi_port_t port)
+{
+    return MIOS32_MIDI_SendEvent(port, 0xfb, 0x00, 0x00);
+}
+
+s32 MIOS32_MIDI_SendStop(mios32_midi_port_t port)
+{
+    return MIOS32_MIDI_SendEvent(port, 0xfc, 0x00, 0x00);
+}
+
+s32 MIOS32_MIDI_SendSysEx(mios32_midi_port_t port, u8 *stream, u32 count)
+{
+    u32 i;
+    if (port == USB0)
+    {
+        for (i = 0; i < count; i++)
+            logWireByte(port, stream[i], simTime, simTime);
+        return 0;
+    }
+    if (port == UART0 || port == UART1)
+    {
+        for (i = 0; i < count; i++)
+            uartPutBlocking(port - UART0, stream[i]);
+        return 0;
+    }
+    return -1;
+}
+
+s32 MIOS32_MIDI_SendDebugMessage(const char *format, ...)
+{
+    stats.debugMessages++;
+    if (verboseOutput)
+    {
+        va_list args;
+        va_start(args, format);
+        printf("[%10.3f ms] ", simTime / 1000.0);
+        vprintf(format, args);
+        printf("\n");
+        va_end(args);
+    }
+    return 0;
+}
+
+s32 MIOS32_MIDI_DirectRxCallback_Init(s32 (*callback_rx)(mios32_midi_port_t port, u8 midi_byte))
+{
+    directRxCallback = callback_rx;
+    return 0;
+}
@@ -0,0 +1,35 @@
+/*
+ * Host-side replacement for the FreeRTOS task API
+ *
+ * ==========================================================================
+ *
+ *  Licensed for personal non-commercial use only.
+ *  All other rights reserved.
+ *
+ * ==========================================================================
+ */
+
+#ifndef _TASK_H
+#define _TASK_H
+
+
+/////////////////////////////////////////////////////////////////////////////
+// Global Types
+/////////////////////////////////////////////////////////////////////////////
+
+typedef void *xTaskHandle;
+typedef void (*pdTASK_CODE)(void *pvParameters);
+
+
+/////////////////////////////////////////////////////////////////////////////
+// Prototypes
+/////////////////////////////////////////////////////////////////////////////
+
+extern portBASE_TYPE xTaskCreate(pdTASK_CODE pvTaskCode, const signed portCHAR *pcName,
+                                 unsigned short usStackDepth, void *pvParameters,
+                                 unsigned portBASE_TYPE uxPriority, xTaskHandle *pxCreatedTask);
+extern portTickType xTaskGetTickCount(void);
+extern void vTaskDelayUntil(portTickType *pxPreviousWakeTime, portTickType xTimeIncrement);
+extern void vTaskDelay(portTickType xTicksToDelay);
+
+#endif /* _TASK_H */
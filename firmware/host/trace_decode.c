@@ -0,0 +1,454 @@
+/* Decoder of the trace dump of the controller (see ../trace.c).
+
+   Reads the bytes received from USB0 after sending F0 7D 52 43 03 F7, e.g.
+   a .syx file saved with the SysEx tool of MIOS Studio or written by
+   rytm_bench -u, and prints the recorded events as a timeline: the MIDI
+   messages per port and direction, the buttons, the pots, the sync points
+   and the queued changes when they have been fired.
+
+   For each fired change, the lateness is estimated from the trace alone:
+   the burst of messages sent to the Rytm right after the change ends on
+   the wire one byte time (320 uS) after its last byte has been handed to
+   the UART. The lateness is that end relative to the sync point with the
+   song position the change has been queued for. Other traffic on UART1 in
+   the same burst (e.g. pot movements) is counted with it.
+
+   The exit status is 1 if the dump is incomplete.
+
+   Usage: trace_decode [-c] <dump.syx>
+        -c  also list the clock ticks (0xF8), which are only counted by
+            default
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef unsigned char u8;
+typedef unsigned int u32;
+typedef int s32;
+
+// must match ../trace.h
+#define TRACE_MIDI_IN    0x00
+#define TRACE_MIDI_OUT   0x10
+#define TRACE_BUTTON     0x20
+#define TRACE_POT        0x30
+#define TRACE_SYNC_POINT 0x40
+#define TRACE_ACTION     0x50
+#define EVENT_BYTES      8
+
+#define SYSEX_TRACE_DUMP 0x03
+
+// one byte at 31250 baud
+#define BYTE_US          320
+// the burst of an action starts within and has no gaps longer than this
+#define BURST_GAP_US     1000
+
+typedef struct
+{
+    u32 time;
+    u8 type;
+    u8 data[3];
+} event_t;
+
+static event_t *events;
+static u32 numEvents;
+static int incomplete;  // a message of the dump is missing
+
+static const char *portName[3] = { "USB0", "UART0", "UART1" };
+static const char *actionName[4] = { "kill", "scene", "mutes", "macros" };
+
+/////////////////////////////////////////////////////////////////////////////
+// Reading the dump
+/////////////////////////////////////////////////////////////////////////////
+
+/////////////////////////////////////////////////////////////////////////////
+// unpacks one message of the dump, the events are appended in the order of
+// the message numbers. Message 0 starts a new dump.
+/////////////////////////////////////////////////////////////////////////////
+static void unpackMessage(const u8 *m, u32 len, u32 *expected)
+{
+    u32 number = (m[0] << 7) | m[1];
+    if (number == 0)
+        numEvents = 0;
+    else if (number != *expected)
+    {
+        fprintf(stderr, "message %u of the dump is missing\n", *expected);
+        numEvents = 0;
+        incomplete = 1;
+    }
+    *expected = number + 1;
+
+    u8 b[EVENT_BYTES];
+    u32 packed = 0;
+    u32 i;
+    u8 msbs = 0;
+    for (i = 2; i < len; i++)
+    {
+        if (((i - 2) % 8) == 0)
+        {
+            msbs = m[i];
+            continue;
+        }
+        b[packed % EVENT_BYTES] = m[i] | ((msbs << (((i - 2) % 8))) & 0x80);
+        if ((++packed % EVENT_BYTES) == 0)
+        {
+            events = realloc(events, (numEvents + 1) * sizeof(event_t));
+            if (!events)
+            {
+                fprintf(stderr, "out of memory\n");
+                exit(1);
+            }
+            event_t *e = &events[numEvents++];
+            e->time = b[0] | (b[1] << 8) | (b[2] << 16) | ((u32)b[3] << 24);
+            e->type = b[4];
+            memcpy(e->data, &b[5], 3);
+        }
+    }
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// extracts the dump messages from the received bytes, anything else is
+// skipped
+/////////////////////////////////////////////////////////////////////////////
+static int readDump(const char *file)
+{
+    static const u8 header[] = { 0xf0, 0x7d, 0x52, 0x43, SYSEX_TRACE_DUMP };
+    FILE *f = fopen(file, "rb");
+    if (!f)
+    {
+        perror(file);
+        return -1;
+    }
+
+    u8 *m = NULL;
+    u32 len = 0, size = 0;
+    u32 pos = 0; // position in the header, beyond it in the message
+    u32 expected = 0;
+    int c;
+    while ((c = fgetc(f)) != EOF)
+    {
+        if (c == 0xf0)
+            pos = 0;
+        if (pos < sizeof(header))
+        {
+            pos = (c == header[pos]) ? pos + 1 : sizeof(header) + 1;
+            len = 0;
+            continue;
+        }
+        if (pos > sizeof(header))
+            continue; // not a dump message
+        if (c == 0xf7)
+        {
+            if (len >= 2)
+                unpackMessage(m, len, &expected);
+            pos = sizeof(header) + 1;
+            continue;
+        }
+        if (len >= size)
+        {
+            size = size ? 2 * size : 256;
+            m = realloc(m, size);
+            if (!m)
+            {
+                fprintf(stderr, "out of memory\n");
+                exit(1);
+            }
+        }
+        m[len++] = c;
+    }
+    fclose(f);
+    free(m);
+    return 0;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// Timeline
+/////////////////////////////////////////////////////////////////////////////
+
+typedef struct
+{
+    u8 status;      // running status, 0 == none
+    u8 msg[2];
+    u8 len;
+    u32 sysexBytes; // > 0 while receiving a SysEx
+} midiParser_t;
+
+/////////////////////////////////////////////////////////////////////////////
+// number of data bytes of a message with the given status
+/////////////////////////////////////////////////////////////////////////////
+static u8 dataBytes(u8 status)
+{
+    switch (status & 0xf0)
+    {
+        case 0xc0:
+        case 0xd0:
+            return 1;
+        case 0xf0:
+            return (status == 0xf2) ? 2 : ((status == 0xf1) || (status == 0xf3)) ? 1 : 0;
+        default:
+            return 2;
+    }
+}
+
+static void printTime(u32 time, u32 start)
+{
+    printf("%10.3f ms  ", (s32)(time - start) / 1000.0);
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// feeds a MIDI byte into the parser of its port and direction and prints
+// the message once it is complete
+/////////////////////////////////////////////////////////////////////////////
+static void printMidi(midiParser_t *p, const event_t *e, u32 start, int showClock, u32 *clocks)
+{
+    u8 b = e->data[0];
+    const char *dir = ((e->type & 0xf0) == TRACE_MIDI_IN) ? "in " : "out";
+    const char *port = portName[(e->type & 0x0f) < 3 ? (e->type & 0x0f) : 0];
+
+    if (b >= 0xf8)
+    {
+        if (b == 0xf8 && !showClock)
+        {
+            (*clocks)++;
+            return;
+        }
+        printTime(e->time, start);
+        printf("%-5s %s  %02X\n", port, dir, b);
+        return;
+    }
+    if (b == 0xf0)
+    {
+        p->status = 0;
+        p->sysexBytes = 1;
+        return;
+    }
+    if (p->sysexBytes)
+    {
+        p->sysexBytes++;
+        if (b == 0xf7)
+        {
+            printTime(e->time, start);
+            printf("%-5s %s  SysEx, %u bytes\n", port, dir, p->sysexBytes);
+            p->sysexBytes = 0;
+        }
+        return;
+    }
+    if (b & 0x80)
+    {
+        p->status = b;
+        p->len = 0;
+        if (dataBytes(b))
+            return;
+    }
+    else if (!p->status)
+        return;
+    else
+        p->msg[p->len++] = b;
+    if (p->len < dataBytes(p->status))
+        return;
+
+    printTime(e->time, start);
+    printf("%-5s %s  %02X", port, dir, p->status);
+    int i;
+    for (i = 0; i < p->len; i++)
+        printf(" %02X", p->msg[i]);
+    if (p->status < 0xf0)
+        printf("   ch%d", (p->status & 0x0f) + 1);
+    printf("\n");
+    p->len = 0;
+    if (p->status >= 0xf0)
+        p->status = 0; // system common messages cancel the running status
+}
+
+static void printActions(u8 actions)
+{
+    int i;
+    const char *separator = "";
+    for (i = 0; i < 4; i++)
+    {
+        if (actions & (1 << i))
+        {
+            printf("%s%s", separator, actionName[i]);
+            separator = "+";
+        }
+    }
+}
+
+static void printTimeline(int showClock)
+{
+    midiParser_t parser[2][3];
+    u32 clocks = 0;
+    u32 start = events[0].time;
+    u32 i;
+
+    memset(parser, 0, sizeof(parser));
+    for (i = 0; i < numEvents; i++)
+    {
+        const event_t *e = &events[i];
+        u8 index = e->type & 0x0f;
+        switch (e->type & 0xf0)
+        {
+            case TRACE_MIDI_IN:
+            case TRACE_MIDI_OUT:
+                if (index < 3)
+                    printMidi(&parser[(e->type & 0xf0) == TRACE_MIDI_OUT][index], e, start, showClock, &clocks);
+                break;
+            case TRACE_BUTTON:
+                printTime(e->time, start);
+                printf("button %d %s\n", e->data[0], e->data[1] ? "released" : "pressed");
+                break;
+            case TRACE_POT:
+                printTime(e->time, start);
+                printf("pot %d = %d\n", e->data[0], e->data[1] | (e->data[2] << 8));
+                break;
+            case TRACE_SYNC_POINT:
+                printTime(e->time, start);
+                printf("sync point, song position %u\n", e->data[0] | (e->data[1] << 8) | (e->data[2] << 16));
+                break;
+            case TRACE_ACTION:
+                printTime(e->time, start);
+                printf("fired ");
+                printActions(e->data[0]);
+                printf(" for song position %u\n", e->data[1] | (e->data[2] << 8));
+                break;
+            default:
+                printTime(e->time, start);
+                printf("unknown event %02X\n", e->type);
+                break;
+        }
+    }
+    if (clocks)
+        printf("(%u clock ticks not listed)\n", clocks);
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// Lateness of the fired changes
+/////////////////////////////////////////////////////////////////////////////
+
+/////////////////////////////////////////////////////////////////////////////
+// returns the index of the sync point with the given song position which
+// is closest to the time, or -1
+/////////////////////////////////////////////////////////////////////////////
+static s32 findSyncPoint(u32 position, u32 time)
+{
+    s32 found = -1;
+    u32 distance = 0;
+    u32 i;
+    for (i = 0; i < numEvents; i++)
+    {
+        const event_t *e = &events[i];
+        if (e->type != TRACE_SYNC_POINT || ((e->data[0] | (e->data[1] << 8)) != position))
+            continue;
+        u32 d = ((s32)(e->time - time) >= 0) ? e->time - time : time - e->time;
+        if (found < 0 || d < distance)
+        {
+            found = i;
+            distance = d;
+        }
+    }
+    return found;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// returns the time of the last byte of the burst sent to the Rytm after the
+// given event, 0 if there is none
+/////////////////////////////////////////////////////////////////////////////
+static int findBurstEnd(u32 from, u32 *end)
+{
+    u32 last = events[from].time;
+    int found = 0;
+    u32 i;
+    for (i = from + 1; i < numEvents; i++)
+    {
+        const event_t *e = &events[i];
+        if ((s32)(e->time - last) >= BURST_GAP_US)
+            break;
+        if (e->type == (TRACE_MIDI_OUT | 2) && e->data[0] < 0xf8)
+        {
+            last = e->time;
+            found = 1;
+        }
+    }
+    *end = last + BYTE_US;
+    return found;
+}
+
+static void printLateness()
+{
+    u32 start = events[0].time;
+    u32 matched = 0;
+    s32 sumLate = 0, minLate = 0x7fffffff, maxLate = -0x7fffffff;
+    u32 i;
+
+    printf("\nlateness of the fired changes (estimated wire end relative to the sync point):\n");
+    for (i = 0; i < numEvents; i++)
+    {
+        const event_t *e = &events[i];
+        if (e->type != TRACE_ACTION)
+            continue;
+
+        u32 position = e->data[1] | (e->data[2] << 8);
+        printf("  ");
+        printTime(e->time, start);
+        printf("%-18s", "");
+        printActions(e->data[0]);
+        printf(" @%u: ", position);
+
+        s32 sync = findSyncPoint(position, e->time);
+        u32 end;
+        if (sync < 0)
+            printf("no sync point\n");
+        else if (!findBurstEnd(i, &end))
+            printf("nothing sent\n");
+        else
+        {
+            s32 late = (s32)(end - events[sync].time);
+            printf("late %+7.3f ms\n", late / 1000.0);
+            matched++;
+            sumLate += late;
+            if (late < minLate)
+                minLate = late;
+            if (late > maxLate)
+                maxLate = late;
+        }
+    }
+    if (matched)
+        printf("  summary: %u changes, lateness min %+.3f ms mean %+.3f ms max %+.3f ms\n",
+               matched, minLate / 1000.0, sumLate / (double)matched / 1000.0, maxLate / 1000.0);
+    else
+        printf("  summary: no change reached the wire\n");
+}
+
+int main(int argc, char **argv)
+{
+    int showClock = 0;
+    const char *file = NULL;
+    int i;
+
+    for (i = 1; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "-c"))
+            showClock = 1;
+        else
+            file = argv[i];
+    }
+    if (!file)
+    {
+        fprintf(stderr, "usage: %s [-c] <dump.syx>\n", argv[0]);
+        return 1;
+    }
+
+    if (readDump(file) < 0)
+        return 1;
+    if (!numEvents)
+    {
+        fprintf(stderr, "%s: no trace dump found\n", file);
+        return 1;
+    }
+
+    printf("%u events\n", numEvents);
+    printTimeline(showClock);
+    printLateness();
+    return incomplete ? 1 : 0;
+}
@@ -0,0 +1,231 @@
+/* Internal master clock.
+
+   A hardware timer runs with the period of one clock tick (1/24th of a
+   quarter note). On each interrupt the tick is sent to all MIDI outputs and
+   pushed into the MIDI input event queue together with its time, exactly as
+   if it had been received from an external sync source. The sync task
+   therefore drives the sync counter from it without any receive path in
+   between, and the tempo tracker sees perfectly even ticks, so the next
+   sync point is known in advance.
+
+   Start and stop are sent and queued the same way. While the master clock
+   is enabled, the Rx callback doesn't queue anything, so the timer
+   interrupt and the functions called by the application (with interrupts
+   disabled) are the only producers of the event queue.
+
+   The tempo can be set in 1/10 BPM or tapped.
+
+   The MIOS32 timers take a 16 bit period in uS, which ends at 65535 uS or
+   38.2 BPM. Below that, the timer runs with a whole fraction of the tick
+   period and only every n-th interrupt sends a tick.
+*/
+
+/////////////////////////////////////////////////////////////////////////////
+// Include files
+/////////////////////////////////////////////////////////////////////////////
+
+#include <mios32.h>
+#include "master_clock.h"
+#include "midi_in.h"
+#include "midi_out.h"
+#include "timebase.h"
+
+static u8 enabled;
+static u8 running;
+static u32 bpm;           // tempo in 1/10 BPM
+static u32 lastTapTime;
+static u32 numTaps;       // taps of the current measurement
+static u32 tapIntervals[MASTER_CLOCK_TAP_AVERAGE];
+static u32 subTicks;      // timer interrupts per tick
+static u32 subTick;       // interrupts since the last tick
+
+// longest period of the MIOS32 timers in uS
+#define TIMER_PERIOD_MAX 65535
+
+// local prototypes
+static u32 tickPeriod(void);
+static u32 timerPeriod(void);
+static void sendRealtime(u8 midi_byte);
+static void TIMER_MasterClock(void);
+
+/////////////////////////////////////////////////////////////////////////////
+// returns the time between two ticks in uS
+/////////////////////////////////////////////////////////////////////////////
+static u32 tickPeriod(void)
+{
+    // 60 s * 10 / 24 ticks
+    return (25000000 + bpm / 2) / bpm;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// returns the period of the timer in uS and sets the number of interrupts
+// per tick
+/////////////////////////////////////////////////////////////////////////////
+static u32 timerPeriod(void)
+{
+    u32 period = tickPeriod();
+    subTicks = (period + TIMER_PERIOD_MAX - 1) / TIMER_PERIOD_MAX;
+    if (subTick >= subTicks)
+        subTick = 0;
+    return (period + subTicks / 2) / subTicks;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// sends a realtime message to all outputs
+/////////////////////////////////////////////////////////////////////////////
+static void sendRealtime(u8 midi_byte)
+{
+    mios32_midi_package_t package;
+    package.ALL = 0;
+    package.type = 0xf;
+    package.evnt0 = midi_byte;
+    MIDI_OUT_SendPackage(UART0, package);
+    MIDI_OUT_SendPackage(UART1, package);
+    MIDI_OUT_SendPackage(USB0, package);
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// timer interrupt: one clock tick
+/////////////////////////////////////////////////////////////////////////////
+static void TIMER_MasterClock(void)
+{
+    if (!enabled)
+        return;
+    if (++subTick < subTicks)
+        return;
+    subTick = 0;
+    sendRealtime(0xf8);
+    MIDI_IN_Push(0xf8, 0, TIMEBASE_Get());
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// initializes the master clock with 120 BPM. It is disabled.
+/////////////////////////////////////////////////////////////////////////////
+s32 MASTER_CLOCK_Init(void)
+{
+    enabled = 0;
+    running = 0;
+    bpm = 1200;
+    subTicks = 1;
+    subTick = 0;
+    numTaps = 0;
+    lastTapTime = 0;
+    return 0;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// starts or stops sending the clock. A running song is stopped on disable.
+/////////////////////////////////////////////////////////////////////////////
+s32 MASTER_CLOCK_Enable(u8 enable)
+{
+    if (enable == enabled)
+        return 0;
+
+    if (enable)
+    {
+        enabled = 1;
+        subTick = 0;
+        return MIOS32_TIMER_Init(MASTER_CLOCK_TIMER, timerPeriod(), TIMER_MasterClock, MIOS32_IRQ_PRIO_HIGH);
+    }
+
+    if (running)
+    {
+        sendRealtime(0xfc);
+        running = 0;
+    }
+    enabled = 0;
+    return MIOS32_TIMER_DeInit(MASTER_CLOCK_TIMER);
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// sends a start message, the first tick follows one period later
+/////////////////////////////////////////////////////////////////////////////
+s32 MASTER_CLOCK_Start(void)
+{
+    if (!enabled)
+        return -1;
+
+    MIOS32_IRQ_Disable();
+    // restart the timer, so the song starts on a full tick
+    subTick = 0;
+    MIOS32_TIMER_Init(MASTER_CLOCK_TIMER, timerPeriod(), TIMER_MasterClock, MIOS32_IRQ_PRIO_HIGH);
+    sendRealtime(0xfa);
+    MIDI_IN_Push(0xfa, 0, TIMEBASE_Get());
+    running = 1;
+    MIOS32_IRQ_Enable();
+    return 0;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// sends a stop message, the clock keeps running
+/////////////////////////////////////////////////////////////////////////////
+s32 MASTER_CLOCK_Stop(void)
+{
+    if (!enabled)
+        return -1;
+
+    MIOS32_IRQ_Disable();
+    sendRealtime(0xfc);
+    MIDI_IN_Push(0xfc, 0, TIMEBASE_Get());
+    running = 0;
+    MIOS32_IRQ_Enable();
+    return 0;
+}
+
+u8 MASTER_CLOCK_IsRunning(void)
+{
+    return running;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// sets the tempo in 1/10 BPM, it is limited to the allowed range
+/////////////////////////////////////////////////////////////////////////////
+s32 MASTER_CLOCK_BpmSet(u32 value)
+{
+    if (value < MASTER_CLOCK_BPM_MIN)
+        value = MASTER_CLOCK_BPM_MIN;
+    if (value > MASTER_CLOCK_BPM_MAX)
+        value = MASTER_CLOCK_BPM_MAX;
+
+    MIOS32_IRQ_Disable();
+    bpm = value;
+    if (enabled)
+        MIOS32_TIMER_ReInit(MASTER_CLOCK_TIMER, timerPeriod());
+    MIOS32_IRQ_Enable();
+    return 0;
+}
+
+u32 MASTER_CLOCK_BpmGet(void)
+{
+    return bpm;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// tap tempo: call for each tap (time in uS). Sets the tempo from the mean of
+// the last taps and returns 1 if the tap has been part of a measurement,
+// 0 if it started a new one.
+/////////////////////////////////////////////////////////////////////////////
+s32 MASTER_CLOCK_Tap(u32 time)
+{
+    u32 interval = time - lastTapTime;
+    lastTapTime = time;
+
+    if ((numTaps == 0) || (interval >= MASTER_CLOCK_TAP_TIMEOUT))
+    {
+        numTaps = 1;
+        return 0;
+    }
+
+    tapIntervals[(numTaps - 1) % MASTER_CLOCK_TAP_AVERAGE] = interval;
+    numTaps++;
+
+    u32 n = (numTaps - 1 < MASTER_CLOCK_TAP_AVERAGE) ? numTaps - 1 : MASTER_CLOCK_TAP_AVERAGE;
+    u32 sum = 0;
+    int i;
+    for (i = 0; i < n; i++)
+        sum += tapIntervals[i];
+
+    // one tap per quarter note: 600 s / interval in 1/10 BPM
+    MASTER_CLOCK_BpmSet((u32)(((u64)600000000 * n + sum / 2) / sum));
+    return 1;
+}
@@ -0,0 +1,48 @@
+/*
+ * Header file of the internal master clock
+ *
+ * ==========================================================================
+ *
+ *  Licensed for personal non-commercial use only.
+ *  All other rights reserved.
+ *
+ * ==========================================================================
+ */
+
+#ifndef _MASTER_CLOCK_H
+#define _MASTER_CLOCK_H
+
+
+/////////////////////////////////////////////////////////////////////////////
+// Global definitions
+/////////////////////////////////////////////////////////////////////////////
+
+// the MIOS32 timer which generates the clock ticks
+#define MASTER_CLOCK_TIMER 2
+
+// tempo range in 1/10 BPM
+#define MASTER_CLOCK_BPM_MIN  300
+#define MASTER_CLOCK_BPM_MAX 3000
+
+// taps which are further apart (uS) start a new tap tempo measurement
+#define MASTER_CLOCK_TAP_TIMEOUT 2000000
+
+// number of tap intervals which are averaged
+#define MASTER_CLOCK_TAP_AVERAGE 4
+
+
+/////////////////////////////////////////////////////////////////////////////
+// Prototypes
+/////////////////////////////////////////////////////////////////////////////
+
+extern s32 MASTER_CLOCK_Init(void);
+extern s32 MASTER_CLOCK_Enable(u8 enable);
+extern s32 MASTER_CLOCK_Start(void);
+extern s32 MASTER_CLOCK_Stop(void);
+extern u8  MASTER_CLOCK_IsRunning(void);
+extern s32 MASTER_CLOCK_BpmSet(u32 bpm);
+extern u32 MASTER_CLOCK_BpmGet(void);
+extern s32 MASTER_CLOCK_Tap(u32 time);
+
+
+#endif /* _MASTER_CLOCK_H */
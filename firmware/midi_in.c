@@ -0,0 +1,91 @@
+/* Event queue between the MIDI Rx callbacks and the sync task.
+
+   The direct Rx callback is called from the UART receive interrupt, so it
+   must not wait for anything. It only stores the realtime byte (or a
+   complete song position pointer) together with its timestamp
+   (MIDI_IN_Push), the sync logic runs in a task which drains the queue
+   (MIDI_IN_Pop).
+
+   There can be several producers: with MIDI 1 as sync source, the Rx
+   callbacks of USB0 and UART0 both push, from interrupts with different
+   priorities, and the master clock pushes from its timer. MIDI_IN_Push
+   therefore disables the interrupts while it claims a slot, so a
+   preempting producer can't take the same one. There is exactly one
+   consumer (the sync task), which only writes the head index and needs no
+   lock. The memory barrier makes sure that an event has been written
+   completely before the consumer can see the updated tail index.
+*/
+
+/////////////////////////////////////////////////////////////////////////////
+// Include files
+/////////////////////////////////////////////////////////////////////////////
+
+#include <mios32.h>
+#include "midi_in.h"
+
+static midiInEvent_t queue[MIDI_IN_QUEUE_SIZE];
+static volatile u16 queueHead;  // written by the consumer only
+static volatile u16 queueTail;  // written by the producers with interrupts disabled
+static volatile u32 overruns;   // events which didn't fit into the queue
+
+/////////////////////////////////////////////////////////////////////////////
+// empties the queue. Must be called before the Rx callback is installed.
+/////////////////////////////////////////////////////////////////////////////
+s32 MIDI_IN_Init(void)
+{
+    queueHead = 0;
+    queueTail = 0;
+    overruns = 0;
+    return 0;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// adds an event to the queue. Producer side, constant time, may be called
+// from any interrupt.
+// returns -1 if the queue is full
+/////////////////////////////////////////////////////////////////////////////
+s32 MIDI_IN_Push(u8 midi_byte, u16 value, u32 time)
+{
+    MIOS32_IRQ_Disable();
+    u16 tail = queueTail;
+    if ((u16)(tail - queueHead) >= MIDI_IN_QUEUE_SIZE)
+    {
+        overruns++;
+        MIOS32_IRQ_Enable();
+        return -1;
+    }
+
+    midiInEvent_t *event = &queue[tail & (MIDI_IN_QUEUE_SIZE - 1)];
+    event->time = time;
+    event->byte = midi_byte;
+    event->value = value;
+    __DMB();
+    queueTail = tail + 1;
+    MIOS32_IRQ_Enable();
+    return 0;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// takes the oldest event from the queue. Consumer side.
+// returns 1 if an event has been taken, 0 if the queue is empty
+/////////////////////////////////////////////////////////////////////////////
+s32 MIDI_IN_Pop(midiInEvent_t *event)
+{
+    u16 head = queueHead;
+    if (head == queueTail)
+        return 0;
+
+    __DMB();
+    *event = queue[head & (MIDI_IN_QUEUE_SIZE - 1)];
+    __DMB();
+    queueHead = head + 1;
+    return 1;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// returns the number of events which have been lost because the queue was full
+/////////////////////////////////////////////////////////////////////////////
+u32 MIDI_IN_OverrunsGet(void)
+{
+    return overruns;
+}
@@ -0,0 +1,46 @@
+/*
+ * Header file of the MIDI input event queue
+ *
+ * ==========================================================================
+ *
+ *  Licensed for personal non-commercial use only.
+ *  All other rights reserved.
+ *
+ * ==========================================================================
+ */
+
+#ifndef _MIDI_IN_H
+#define _MIDI_IN_H
+
+
+/////////////////////////////////////////////////////////////////////////////
+// Global definitions
+/////////////////////////////////////////////////////////////////////////////
+
+// number of events the queue can hold (must be a power of 2)
+#define MIDI_IN_QUEUE_SIZE 64
+
+
+/////////////////////////////////////////////////////////////////////////////
+// Global Types
+/////////////////////////////////////////////////////////////////////////////
+
+typedef struct
+{
+    u32 time;   // uS time base at the moment the byte has been received
+    u16 value;  // song position in 1/16th notes (0xf2 only)
+    u8 byte;    // realtime message (0xf8..0xff) or song position pointer (0xf2)
+} midiInEvent_t;
+
+
+/////////////////////////////////////////////////////////////////////////////
+// Prototypes
+/////////////////////////////////////////////////////////////////////////////
+
+extern s32 MIDI_IN_Init(void);
+extern s32 MIDI_IN_Push(u8 midi_byte, u16 value, u32 time);
+extern s32 MIDI_IN_Pop(midiInEvent_t *event);
+extern u32 MIDI_IN_OverrunsGet(void);
+
+
+#endif /* _MIDI_IN_H */
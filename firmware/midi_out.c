@@ -0,0 +1,533 @@
+/* MIDI output scheduler for the UARTs (the Rytm and MIDI 1 Out).
+
+   All messages for UART0 and UART1 go through this module instead of
+   MIOS32_MIDI_SendPackage. There are three priority classes:
+        1. realtime messages (clock, start, stop...) are not queued. They
+           go out immediately, ahead of everything which is still waiting.
+        2. ordered messages (sync point actions, MIDI thru) are collected
+           in a batch until MIDI_OUT_Flush() is called, at the latest once
+           per mS from MIDI_OUT_Tick(). While collecting, a channel message
+           is moved up behind the last message with the same status byte,
+           as long as it doesn't overtake a message on its own channel or a
+           system message. The batch is then encoded with running status
+           into the FIFO: within a group, only the first message carries
+           the status byte. A 12 CC performance kill takes 25 bytes
+           instead of 36.
+        3. coalesced CCs and NRPNs (pot movements) only keep the latest
+           value per channel and CC or parameter number. They are encoded
+           when the FIFO is empty, so a burst of pot movements drops stale
+           values instead of delaying the sync point actions. An NRPN is
+           encoded as its four CCs in one go. If all slots are taken, a
+           new value is queued as an ordered message, so it isn't lost.
+
+   The FIFO is drained into the UART buffer with a budget of wire time
+   which grows with the elapsed time (one byte per 320 uS at 31250 baud)
+   and is capped at MIDI_OUT_BUDGET_MAX_US. MIDI_OUT_Service() is called
+   from a fast timer interrupt to refill the UART buffer byte by byte, so it
+   never holds more than two bytes, and realtime messages and newly queued sync
+   actions don't have to wait behind a full buffer of stale pot values.
+   Nothing ever blocks: the UART buffer is only written with the
+   non-blocking MIOS32 calls, a byte which doesn't fit stays in the FIFO.
+
+   All other ports are passed on to MIOS32_MIDI_SendPackage.
+*/
+
+/////////////////////////////////////////////////////////////////////////////
+// Include files
+/////////////////////////////////////////////////////////////////////////////
+
+#include <mios32.h>
+#include <string.h>
+#include "midi_out.h"
+#include "timebase.h"
+#include "trace.h"
+
+typedef struct
+{
+    u8 status;
+    u8 isNrpn;
+    u16 number;     // CC or NRPN parameter number
+    u16 value;      // 7 bit for CCs, 14 bit for NRPNs
+} midiOutCoalesced_t;
+
+typedef struct
+{
+    mios32_midi_port_t port;
+    u8 uart;
+    u8 runningStatus;
+    u32 runningStatusTime;
+    s32 budget;         // wire time in uS which may be handed to the UART
+    u32 budgetTime;     // time of the last budget update
+    u8 numBatched;
+    mios32_midi_package_t batch[MIDI_OUT_BATCH_SIZE];
+    u8 numCoalesced;
+    midiOutCoalesced_t coalesced[MIDI_OUT_COALESCE_SIZE];
+    u8 fifo[MIDI_OUT_FIFO_SIZE];
+    u16 fifoHead;
+    u16 fifoTail;
+    u16 highWater;      // max. number of bytes in the FIFO and the UART buffer
+    u32 droppedBytes;
+    u32 droppedValues;  // coalesced values which have been replaced before they were sent
+} midiOutPort_t;
+
+#define NUM_PORTS (sizeof(ports)/sizeof(midiOutPort_t))
+
+static midiOutPort_t ports[] =
+{
+    { .port = UART0, .uart = UART0 & 0x0f },
+    { .port = UART1, .uart = UART1 & 0x0f },
+};
+
+// local prototypes
+static midiOutPort_t *findPort(mios32_midi_port_t port);
+static u8 packageLength(mios32_midi_package_t package);
+static u8 isChannelMessage(mios32_midi_package_t package);
+static void batchInsert(midiOutPort_t *p, mios32_midi_package_t package);
+static void dropCoalesced(midiOutPort_t *p, u8 status, u8 isNrpn, u16 number);
+static s32 coalesce(mios32_midi_port_t port, u8 status, u8 isNrpn, u16 number, u16 value);
+static void fifoPut(midiOutPort_t *p, u8 b);
+static void encodeChannelMessage(midiOutPort_t *p, u8 status, u8 evnt1, u8 evnt2, u8 len, u32 now);
+static void flushPort(midiOutPort_t *p);
+static void servicePort(midiOutPort_t *p);
+static void updateHighWater(midiOutPort_t *p);
+
+static midiOutPort_t *findPort(mios32_midi_port_t port)
+{
+    int i;
+    for (i = 0; i < NUM_PORTS; i++)
+    {
+        if (ports[i].port == port)
+            return &ports[i];
+    }
+    return NULL;
+}
+
+static u8 packageLength(mios32_midi_package_t package)
+{
+    switch (package.type)
+    {
+        case 0x2: case 0x6: case 0xc: case 0xd:
+            return 2;
+        case 0x3: case 0x4: case 0x7: case 0x8: case 0x9: case 0xa: case 0xb: case 0xe:
+            return 3;
+        case 0x5: case 0xf:
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+static u8 isChannelMessage(mios32_midi_package_t package)
+{
+    return (package.type >= 0x8) && (package.type <= 0xe);
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// adds a message to the batch, behind the last message with the same status
+// if that doesn't change the order on the message's channel
+/////////////////////////////////////////////////////////////////////////////
+static void batchInsert(midiOutPort_t *p, mios32_midi_package_t package)
+{
+    int pos = p->numBatched;
+
+    if (isChannelMessage(package))
+    {
+        int i;
+        for (i = p->numBatched - 1; i >= 0; i--)
+        {
+            mios32_midi_package_t other = p->batch[i];
+            if (other.evnt0 == package.evnt0)
+            {
+                pos = i + 1;
+                break;
+            }
+            if (!isChannelMessage(other) || (other.chn == package.chn))
+                break;
+        }
+    }
+
+    memmove(&p->batch[pos + 1], &p->batch[pos], (p->numBatched - pos) * sizeof(mios32_midi_package_t));
+    p->batch[pos] = package;
+    p->numBatched++;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// removes a pending coalesced value, it would overwrite a newer ordered one
+/////////////////////////////////////////////////////////////////////////////
+static void dropCoalesced(midiOutPort_t *p, u8 status, u8 isNrpn, u16 number)
+{
+    int i;
+    for (i = 0; i < p->numCoalesced; i++)
+    {
+        midiOutCoalesced_t *c = &p->coalesced[i];
+        if ((c->status == status) && (c->isNrpn == isNrpn) && (c->number == number))
+        {
+            memmove(&p->coalesced[i], &p->coalesced[i + 1], (p->numCoalesced - i - 1) * sizeof(midiOutCoalesced_t));
+            p->numCoalesced--;
+            p->droppedValues++;
+            return;
+        }
+    }
+}
+
+static void fifoPut(midiOutPort_t *p, u8 b)
+{
+    if ((u16)(p->fifoTail - p->fifoHead) >= MIDI_OUT_FIFO_SIZE)
+    {
+        p->droppedBytes++;
+        return;
+    }
+    p->fifo[p->fifoTail++ & (MIDI_OUT_FIFO_SIZE - 1)] = b;
+}
+
+static void encodeChannelMessage(midiOutPort_t *p, u8 status, u8 evnt1, u8 evnt2, u8 len, u32 now)
+{
+    if ((status != p->runningStatus) || ((now - p->runningStatusTime) > MIDI_OUT_RUNNING_STATUS_REFRESH))
+    {
+        fifoPut(p, status);
+        p->runningStatus = status;
+        p->runningStatusTime = now;
+    }
+    fifoPut(p, evnt1);
+    if (len == 3)
+        fifoPut(p, evnt2);
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// encodes the batch into the FIFO, using running status
+/////////////////////////////////////////////////////////////////////////////
+static void flushPort(midiOutPort_t *p)
+{
+    if (!p->numBatched)
+        return;
+
+    u32 now = TIMEBASE_Get();
+    int i;
+    for (i = 0; i < p->numBatched; i++)
+    {
+        mios32_midi_package_t package = p->batch[i];
+        u8 len = packageLength(package);
+
+        if (isChannelMessage(package))
+        {
+            encodeChannelMessage(p, package.evnt0, package.evnt1, package.evnt2, len, now);
+        }
+        else if (len)
+        {
+            // SysEx and system common messages cancel the running status
+            fifoPut(p, package.evnt0);
+            if (len >= 2)
+                fifoPut(p, package.evnt1);
+            if (len >= 3)
+                fifoPut(p, package.evnt2);
+            p->runningStatus = 0;
+        }
+    }
+    p->numBatched = 0;
+    updateHighWater(p);
+}
+
+static void updateHighWater(midiOutPort_t *p)
+{
+    u16 queued = (u16)(p->fifoTail - p->fifoHead) + MIOS32_UART_TxBufferUsed(p->uart);
+    if (queued > p->highWater)
+        p->highWater = queued;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// hands as many bytes to the UART as the budget allows. Coalesced values
+// are only encoded once all ordered bytes are gone.
+/////////////////////////////////////////////////////////////////////////////
+static void servicePort(midiOutPort_t *p)
+{
+    u32 now = TIMEBASE_Get();
+    p->budget += now - p->budgetTime;
+    p->budgetTime = now;
+    if (p->budget > MIDI_OUT_BUDGET_MAX_US)
+        p->budget = MIDI_OUT_BUDGET_MAX_US;
+
+    while (p->budget >= MIDI_OUT_BYTE_US)
+    {
+        if (p->fifoHead == p->fifoTail)
+        {
+            if (!p->numCoalesced)
+                break;
+
+            midiOutCoalesced_t *c = &p->coalesced[0];
+            if (c->isNrpn)
+            {
+                encodeChannelMessage(p, c->status, 99, c->number >> 7, 3, now);
+                encodeChannelMessage(p, c->status, 98, c->number & 0x7f, 3, now);
+                encodeChannelMessage(p, c->status, 6, c->value >> 7, 3, now);
+                encodeChannelMessage(p, c->status, 38, c->value & 0x7f, 3, now);
+            }
+            else
+                encodeChannelMessage(p, c->status, c->number, c->value, 3, now);
+            memmove(&p->coalesced[0], &p->coalesced[1], (p->numCoalesced - 1) * sizeof(midiOutCoalesced_t));
+            p->numCoalesced--;
+        }
+
+        // copy the contiguous part of the FIFO in one go
+        u16 head = p->fifoHead & (MIDI_OUT_FIFO_SIZE - 1);
+        u16 len = (u16)(p->fifoTail - p->fifoHead);
+        if (len > MIDI_OUT_FIFO_SIZE - head)
+            len = MIDI_OUT_FIFO_SIZE - head;
+        if (len > p->budget / MIDI_OUT_BYTE_US)
+            len = p->budget / MIDI_OUT_BYTE_US;
+        if (MIOS32_UART_TxBufferPutMore_NonBlocking(p->uart, &p->fifo[head], len) < 0)
+            break;
+        int i;
+        for (i = 0; i < len; i++)
+            TRACE_MidiOut(p->port, p->fifo[head + i]);
+        p->fifoHead += len;
+        p->budget -= len * MIDI_OUT_BYTE_US;
+    }
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// initializes the output scheduler
+/////////////////////////////////////////////////////////////////////////////
+s32 MIDI_OUT_Init(void)
+{
+    u32 now = TIMEBASE_Get();
+    int i;
+    for (i = 0; i < NUM_PORTS; i++)
+    {
+        ports[i].runningStatus = 0;
+        ports[i].runningStatusTime = now;
+        ports[i].budget = 0;
+        ports[i].budgetTime = now;
+        ports[i].numBatched = 0;
+        ports[i].numCoalesced = 0;
+        ports[i].fifoHead = 0;
+        ports[i].fifoTail = 0;
+        ports[i].highWater = 0;
+        ports[i].droppedBytes = 0;
+        ports[i].droppedValues = 0;
+    }
+    return 0;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// queues a package for sending. Realtime messages are sent immediately.
+/////////////////////////////////////////////////////////////////////////////
+s32 MIDI_OUT_SendPackage(mios32_midi_port_t port, mios32_midi_package_t package)
+{
+    midiOutPort_t *p = findPort(port);
+    if (!p)
+    {
+        u8 len = packageLength(package);
+        if (len)
+            TRACE_MidiOut(port, package.evnt0);
+        if (len >= 2)
+            TRACE_MidiOut(port, package.evnt1);
+        if (len >= 3)
+            TRACE_MidiOut(port, package.evnt2);
+        return MIOS32_MIDI_SendPackage(port, package);
+    }
+
+    MIOS32_IRQ_Disable();
+    if ((package.type == 0xf) && (package.evnt0 >= 0xf8))
+    {
+        // realtime messages don't affect the running status and may be
+        // sent in between any other bytes
+        if (MIOS32_UART_TxBufferPut_NonBlocking(p->uart, package.evnt0) >= 0)
+        {
+            TRACE_MidiOut(p->port, package.evnt0);
+            p->budget -= MIDI_OUT_BYTE_US;
+        }
+        else if ((u16)(p->fifoTail - p->fifoHead) < MIDI_OUT_FIFO_SIZE)
+        {
+            p->fifo[--p->fifoHead & (MIDI_OUT_FIFO_SIZE - 1)] = package.evnt0;
+            updateHighWater(p);
+        }
+        else
+            p->droppedBytes++;
+    }
+    else
+    {
+        if (package.type == CC)
+            dropCoalesced(p, package.evnt0, 0, package.cc_number);
+        if (p->numBatched >= MIDI_OUT_BATCH_SIZE)
+            flushPort(p);
+        batchInsert(p, package);
+    }
+    MIOS32_IRQ_Enable();
+
+    return 0;
+}
+
+s32 MIDI_OUT_SendCC(mios32_midi_port_t port, mios32_midi_chn_t chn, u8 cc, u8 value)
+{
+    mios32_midi_package_t package;
+    package.ALL = 0;
+    package.type = CC;
+    package.event = CC;
+    package.chn = chn;
+    package.value1 = cc;
+    package.value2 = value;
+    return MIDI_OUT_SendPackage(port, package);
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// queues an NRPN (14 bit value) as four ordered CCs
+/////////////////////////////////////////////////////////////////////////////
+s32 MIDI_OUT_SendNRPN(mios32_midi_port_t port, mios32_midi_chn_t chn, u16 number, u16 value)
+{
+    midiOutPort_t *p = findPort(port);
+    if (p)
+    {
+        // a pending coalesced value of the same parameter would overwrite this one
+        MIOS32_IRQ_Disable();
+        dropCoalesced(p, 0xb0 | chn, 1, number);
+        MIOS32_IRQ_Enable();
+    }
+
+    s32 status = 0;
+    status |= MIDI_OUT_SendCC(port, chn, 99, number >> 7);
+    status |= MIDI_OUT_SendCC(port, chn, 98, number & 0x7f);
+    status |= MIDI_OUT_SendCC(port, chn, 6, value >> 7);
+    status |= MIDI_OUT_SendCC(port, chn, 38, value & 0x7f);
+    return status;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// queues a CC with the lowest priority. If the same CC is still waiting,
+// only its value is updated. Without a free slot, the CC is queued as an
+// ordered message.
+/////////////////////////////////////////////////////////////////////////////
+s32 MIDI_OUT_SendCoalescedCC(mios32_midi_port_t port, mios32_midi_chn_t chn, u8 cc, u8 value)
+{
+    if (!findPort(port))
+        return MIDI_OUT_SendCC(port, chn, cc, value);
+    return coalesce(port, 0xb0 | chn, 0, cc, value);
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// same for an NRPN (14 bit value)
+/////////////////////////////////////////////////////////////////////////////
+s32 MIDI_OUT_SendCoalescedNRPN(mios32_midi_port_t port, mios32_midi_chn_t chn, u16 number, u16 value)
+{
+    if (!findPort(port))
+        return MIDI_OUT_SendNRPN(port, chn, number, value);
+    return coalesce(port, 0xb0 | chn, 1, number, value);
+}
+
+static s32 coalesce(mios32_midi_port_t port, u8 status, u8 isNrpn, u16 number, u16 value)
+{
+    midiOutPort_t *p = findPort(port);
+    s32 result = 0;
+    int i;
+
+    MIOS32_IRQ_Disable();
+    for (i = 0; i < p->numCoalesced; i++)
+    {
+        midiOutCoalesced_t *c = &p->coalesced[i];
+        if ((c->status == status) && (c->isNrpn == isNrpn) && (c->number == number))
+        {
+            c->value = value;
+            p->droppedValues++;
+            break;
+        }
+    }
+    if (i == p->numCoalesced)
+    {
+        if (p->numCoalesced < MIDI_OUT_COALESCE_SIZE)
+        {
+            midiOutCoalesced_t *c = &p->coalesced[i];
+            c->status = status;
+            c->isNrpn = isNrpn;
+            c->number = number;
+            c->value = value;
+            p->numCoalesced++;
+        }
+        else
+            result = -1; // no free slot
+    }
+    MIOS32_IRQ_Enable();
+
+    // the newest value must not be lost, send it in order instead
+    if (result < 0)
+    {
+        if (isNrpn)
+            result = MIDI_OUT_SendNRPN(port, status & 0x0f, number, value);
+        else
+            result = MIDI_OUT_SendCC(port, status & 0x0f, number, value);
+    }
+    return result;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// encodes all collected messages and starts sending them
+/////////////////////////////////////////////////////////////////////////////
+s32 MIDI_OUT_Flush(void)
+{
+    int i;
+    MIOS32_IRQ_Disable();
+    for (i = 0; i < NUM_PORTS; i++)
+    {
+        flushPort(&ports[i]);
+        servicePort(&ports[i]);
+    }
+    MIOS32_IRQ_Enable();
+    return 0;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// has to be called each mS
+/////////////////////////////////////////////////////////////////////////////
+s32 MIDI_OUT_Tick(void)
+{
+    return MIDI_OUT_Flush();
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// moves encoded bytes to the UARTs as the budget allows. Doesn't touch the
+// batch, so it can be called from an interrupt at any time.
+/////////////////////////////////////////////////////////////////////////////
+s32 MIDI_OUT_Service(void)
+{
+    int i;
+    MIOS32_IRQ_Disable();
+    for (i = 0; i < NUM_PORTS; i++)
+        servicePort(&ports[i]);
+    MIOS32_IRQ_Enable();
+    return 0;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// returns the number of ordered bytes which still have to go out on a port,
+// including the ones in the UART buffer
+/////////////////////////////////////////////////////////////////////////////
+u32 MIDI_OUT_PendingBytes(mios32_midi_port_t port)
+{
+    midiOutPort_t *p = findPort(port);
+    if (!p)
+        return 0;
+
+    u32 bytes = MIOS32_UART_TxBufferUsed(p->uart);
+    bytes += (u16)(p->fifoTail - p->fifoHead);
+    // batched messages are not encoded yet, estimate them
+    bytes += 3 * p->numBatched;
+    return bytes;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// returns the max. number of bytes which have been waiting on a port since
+// power-on
+/////////////////////////////////////////////////////////////////////////////
+u32 MIDI_OUT_HighWaterGet(mios32_midi_port_t port)
+{
+    midiOutPort_t *p = findPort(port);
+    return p ? p->highWater : 0;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// returns the number of bytes which have been lost because the FIFO of a
+// port was full
+/////////////////////////////////////////////////////////////////////////////
+u32 MIDI_OUT_DroppedBytesGet(mios32_midi_port_t port)
+{
+    midiOutPort_t *p = findPort(port);
+    return p ? p->droppedBytes : 0;
+}
@@ -0,0 +1,63 @@
+/*
+ * Header file of the MIDI output stage
+ *
+ * ==========================================================================
+ *
+ *  Licensed for personal non-commercial use only.
+ *  All other rights reserved.
+ *
+ * ==========================================================================
+ */
+
+#ifndef _MIDI_OUT_H
+#define _MIDI_OUT_H
+
+
+/////////////////////////////////////////////////////////////////////////////
+// Global definitions
+/////////////////////////////////////////////////////////////////////////////
+
+// max. number of messages which are collected before they are encoded
+#define MIDI_OUT_BATCH_SIZE 48
+
+// encoded bytes waiting for room in the UART buffer (must be a power of 2)
+#define MIDI_OUT_FIFO_SIZE 256
+
+// the status byte is repeated if it hasn't been sent for this time (uS),
+// so a receiver which has been plugged in late can pick up the stream
+#define MIDI_OUT_RUNNING_STATUS_REFRESH 100000
+
+// max. number of different CCs and NRPNs which are coalesced per port: the
+// 12 macros of two targets on the same port. If the table is full, a value
+// is sent as an ordered message instead.
+#define MIDI_OUT_COALESCE_SIZE 24
+
+// wire time of one byte at 31250 baud (uS)
+#define MIDI_OUT_BYTE_US 320
+
+// max. wire time which is handed to the UART in advance (uS). Keeps the
+// UART buffer short, so new messages don't wait behind stale ones. Has to
+// cover the interval MIDI_OUT_Service() is called with (the clock output
+// timer), or the UART runs idle in between.
+#define MIDI_OUT_BUDGET_MAX_US 640
+
+
+/////////////////////////////////////////////////////////////////////////////
+// Prototypes
+/////////////////////////////////////////////////////////////////////////////
+
+extern s32 MIDI_OUT_Init(void);
+extern s32 MIDI_OUT_SendPackage(mios32_midi_port_t port, mios32_midi_package_t package);
+extern s32 MIDI_OUT_SendCC(mios32_midi_port_t port, mios32_midi_chn_t chn, u8 cc, u8 value);
+extern s32 MIDI_OUT_SendNRPN(mios32_midi_port_t port, mios32_midi_chn_t chn, u16 number, u16 value);
+extern s32 MIDI_OUT_SendCoalescedCC(mios32_midi_port_t port, mios32_midi_chn_t chn, u8 cc, u8 value);
+extern s32 MIDI_OUT_SendCoalescedNRPN(mios32_midi_port_t port, mios32_midi_chn_t chn, u16 number, u16 value);
+extern s32 MIDI_OUT_Flush(void);
+extern s32 MIDI_OUT_Tick(void);
+extern s32 MIDI_OUT_Service(void);
+extern u32 MIDI_OUT_PendingBytes(mios32_midi_port_t port);
+extern u32 MIDI_OUT_HighWaterGet(mios32_midi_port_t port);
+extern u32 MIDI_OUT_DroppedBytesGet(mios32_midi_port_t port);
+
+
+#endif /* _MIDI_OUT_H */
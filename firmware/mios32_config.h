@@ -49,7 +49,9 @@
 // define the deadband (min. difference to report a change to the application hook)
 // typically set to (2^(12-desired_resolution)-1)
 // e.g. for a resolution of 7 bit, it's set to (2^(12-7)-1) = (2^5 - 1) = 31
-#define MIOS32_AIN_DEADBAND 31
+// The pots are filtered by the application (pots.c), which needs every
+// conversion result, so the deadband is disabled.
+#define MIOS32_AIN_DEADBAND 0
 
 #define MIOS32_SRIO_NUM_SR 2
 #define MIOS32_ENC_NUM_MAX 0
@@ -57,6 +59,9 @@
 #define MIOS32_MIDI_DEBUG_PORT USB0
 #define MIOS32_USB_MIDI_NUM_PORTS 1
 
+// the journaled settings (store.h) take 192 halfwords of the emulated EEPROM
+#define EEPROM_EMULATED_SIZE 256
+
 // enable 1 BankStick
 #define MIOS32_IIC_BS_NUM 1
 
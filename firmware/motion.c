@@ -0,0 +1,248 @@
+/* Motion recorder for the performance pots.
+
+   The 7 bit values of the pots are sampled once per clock tick and stored
+   as a stream of bytes, only the changes are recorded:
+        0x00..0x5f  small change of a pot: pot = b >> 3, the lower 3 bits
+                    encode -4..-1, +1..+4
+        0x60..0x6b  pot b - 0x60 jumps to the value in the next byte
+        0x80..0xff  the following changes happen (b & 0x7f) + 1 ticks later
+   The values at the start of the loop are kept separately. A pot moved
+   slowly costs one byte per tick, ticks without changes cost one byte per
+   128 ticks. A 4 bar loop (384 ticks) with three pots moving all the time
+   takes about 1.5 KB.
+
+   On playback, the stream is decoded tick by tick. At the end of the loop
+   all pots which have moved in the recording jump back to their values at
+   the start.
+*/
+
+/////////////////////////////////////////////////////////////////////////////
+// Include files
+/////////////////////////////////////////////////////////////////////////////
+
+#include <mios32.h>
+#include "motion.h"
+
+#define CODE_ABSOLUTE 0x60
+#define CODE_ADVANCE  0x80
+#define MAX_ADVANCE   128
+
+static u8 buffer[MOTION_BUFFER_SIZE];
+static u32 numBytes;
+static u8 startValues[MOTION_NUM];
+static u16 movedPots;       // bit flags: the pot changes in the recording
+static u32 length;          // loop length in ticks, 0 == nothing recorded
+
+// recorder
+static u8 recordValues[MOTION_NUM];
+static u32 recordTick;
+static u32 lastEventTick;
+
+// player
+static u32 playPosition;
+static u32 readIndex;
+static u32 nextEventTick;
+
+static s32 put(u8 b)
+{
+    if (numBytes >= MOTION_BUFFER_SIZE)
+        return -1;
+    buffer[numBytes++] = b;
+    return 0;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// Initializes the recorder, there is no recording
+/////////////////////////////////////////////////////////////////////////////
+s32 MOTION_Init(void)
+{
+    numBytes = 0;
+    movedPots = 0;
+    length = 0;
+    return 0;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// Starts a new recording (the old one is lost), values are the pot values
+// at the start of the loop
+/////////////////////////////////////////////////////////////////////////////
+s32 MOTION_RecordStart(const u8 *values)
+{
+    int i;
+    for (i = 0; i < MOTION_NUM; i++)
+        startValues[i] = recordValues[i] = values[i];
+    numBytes = 0;
+    movedPots = 0;
+    length = 0;
+    recordTick = 0;
+    lastEventTick = 0;
+    return 0;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// Records the pot values of the next clock tick. Returns -1 if the buffer
+// is full.
+/////////////////////////////////////////////////////////////////////////////
+s32 MOTION_RecordTick(const u8 *values)
+{
+    recordTick++;
+
+    int i;
+    for (i = 0; i < MOTION_NUM; i++)
+    {
+        s32 delta = (s32)values[i] - (s32)recordValues[i];
+        if (!delta)
+            continue;
+
+        // the ticks since the last change
+        while (lastEventTick != recordTick)
+        {
+            u32 advance = recordTick - lastEventTick;
+            if (advance > MAX_ADVANCE)
+                advance = MAX_ADVANCE;
+            if (put(CODE_ADVANCE | (advance - 1)) < 0)
+                return -1;
+            lastEventTick += advance;
+        }
+
+        if ((delta >= -4) && (delta <= 4))
+        {
+            if (put((i << 3) | ((delta < 0) ? (delta + 4) : (delta + 3))) < 0)
+                return -1;
+        }
+        else if ((put(CODE_ABSOLUTE + i) < 0) || (put(values[i]) < 0))
+            return -1;
+
+        recordValues[i] = values[i];
+        movedPots |= (1 << i);
+    }
+    return 0;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// Ends the recording, the current tick is the start of the next loop.
+// Returns the loop length in ticks.
+/////////////////////////////////////////////////////////////////////////////
+u32 MOTION_RecordStop(void)
+{
+    length = recordTick + 1;
+    return length;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// decodes the changes of the current play position
+/////////////////////////////////////////////////////////////////////////////
+static u16 decode(u8 *values)
+{
+    u16 changed = 0;
+    while ((readIndex < numBytes) && (playPosition == nextEventTick))
+    {
+        u8 b = buffer[readIndex++];
+        if (b & CODE_ADVANCE)
+            nextEventTick += (b & 0x7f) + 1;
+        else if (b >= CODE_ABSOLUTE)
+        {
+            int pot = b - CODE_ABSOLUTE;
+            values[pot] = buffer[readIndex++];
+            changed |= (1 << pot);
+        }
+        else
+        {
+            int pot = b >> 3;
+            int code = b & 7;
+            values[pot] += (code < 4) ? (code - 4) : (code - 3);
+            changed |= (1 << pot);
+        }
+    }
+    return changed;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// moves the player to the start of the loop
+/////////////////////////////////////////////////////////////////////////////
+static u16 restart(u8 *values)
+{
+    playPosition = 0;
+    readIndex = 0;
+    nextEventTick = 0;
+
+    u16 changed = 0;
+    int i;
+    for (i = 0; i < MOTION_NUM; i++)
+    {
+        if (!(movedPots & (1 << i)))
+            continue;
+        if (values[i] != startValues[i])
+            changed |= (1 << i);
+        values[i] = startValues[i];
+    }
+    return changed | decode(values);
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// Advances the player by one clock tick, at the end of the loop it starts
+// over. values holds the pot values of the player. Returns the bit flags
+// of the values which have changed.
+/////////////////////////////////////////////////////////////////////////////
+u16 MOTION_PlayTick(u8 *values)
+{
+    if (!length)
+        return 0;
+
+    if (++playPosition >= length)
+        return restart(values);
+    return decode(values);
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// Moves the player to a position of the loop (in ticks from its start).
+// Returns the bit flags of the values which have changed.
+/////////////////////////////////////////////////////////////////////////////
+u16 MOTION_PlaySeek(u32 position, u8 *values)
+{
+    if (!length)
+        return 0;
+
+    u8 old[MOTION_NUM];
+    int i;
+    for (i = 0; i < MOTION_NUM; i++)
+        old[i] = values[i];
+
+    restart(values);
+    position %= length;
+    while (playPosition < position)
+    {
+        playPosition++;
+        decode(values);
+    }
+
+    u16 changed = 0;
+    for (i = 0; i < MOTION_NUM; i++)
+        if (values[i] != old[i])
+            changed |= (1 << i);
+    return changed;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// Returns the bit flags of the pots which move in the recording
+/////////////////////////////////////////////////////////////////////////////
+u16 MOTION_PotsGet(void)
+{
+    return movedPots;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// Returns the length of the loop in ticks (0 == nothing recorded)
+/////////////////////////////////////////////////////////////////////////////
+u32 MOTION_LengthGet(void)
+{
+    return length;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// Returns the size of the recording in bytes
+/////////////////////////////////////////////////////////////////////////////
+u32 MOTION_BytesGet(void)
+{
+    return numBytes;
+}
@@ -0,0 +1,42 @@
+/*
+ * Header file of the motion recorder
+ *
+ * ==========================================================================
+ *
+ *  Licensed for personal non-commercial use only.
+ *  All other rights reserved.
+ *
+ * ==========================================================================
+ */
+
+#ifndef _MOTION_H
+#define _MOTION_H
+
+
+/////////////////////////////////////////////////////////////////////////////
+// Global definitions
+/////////////////////////////////////////////////////////////////////////////
+
+// number of recorded pots
+#define MOTION_NUM 12
+
+// size of the recording in bytes
+#define MOTION_BUFFER_SIZE 4096
+
+
+/////////////////////////////////////////////////////////////////////////////
+// Prototypes
+/////////////////////////////////////////////////////////////////////////////
+
+extern s32 MOTION_Init(void);
+extern s32 MOTION_RecordStart(const u8 *values);
+extern s32 MOTION_RecordTick(const u8 *values);
+extern u32 MOTION_RecordStop(void);
+extern u16 MOTION_PlayTick(u8 *values);
+extern u16 MOTION_PlaySeek(u32 position, u8 *values);
+extern u16 MOTION_PotsGet(void);
+extern u32 MOTION_LengthGet(void);
+extern u32 MOTION_BytesGet(void);
+
+
+#endif /* _MOTION_H */
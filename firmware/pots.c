@@ -0,0 +1,236 @@
+/* Filter for the performance pots.
+
+   Each pot runs through a first order low pass of its 12 bit conversion
+   results. The noise of the ADC dithers the input, so the averaged value
+   has more resolution than a single conversion and is reported with 14 bit.
+
+   Two pots share one 32 bit word, one per halfword. The low pass is done
+   with the halving add of the Cortex-M4 SIMD instructions (__SHADD16), which
+   filters both pots at once: y = (y + (y + (y + x) / 2) / 2) / 2 averages
+   over the last ~8 samples. The values are scaled to 15 bit, so they stay
+   positive in the signed halfwords. The Cortex-M3 (STM32F1) has no SIMD
+   instructions; there the halving add is done on both halfwords with
+   plain 32 bit operations, which gives the same results.
+
+   Each halving rounds down, so the filter settles up to 2^n - 1 (15 bit)
+   below a rising input and on a falling one. The conversion results get a
+   rounding bias of half their LSB, which centers that band on the input,
+   and the scaling to 14 bit is stretched and limited, so both ends of the
+   pot reach 0 and 0x3fff.
+
+   The AIN scan of MIOS32 is not changed by this: it converts one position
+   of the multiplexers each mS, so each pot gets a new conversion result
+   every 8 mS no matter what the filter does, and the ADC and interrupt
+   load stay the same. MIOS32_AIN_PinGet() returns the last result.
+
+   Only the filter work is adaptive. A pair with a moving pot is filtered
+   each mS with the lighter filter (~4 samples), so it follows each new
+   conversion result quickly. The idle pairs are filtered in turns, one per
+   mS, with the stronger filter. Every other idle pair is only compared with
+   its filter state, and filtered at once if a pot is further off than the
+   idle hysteresis, so a pot which starts to move is noticed with its first
+   new conversion result, as if all pots were filtered each mS. With all
+   pots idle, the filter runs for one pair per mS instead of six.
+
+   A new value is only reported if it differs from the last reported one by
+   more than the hysteresis. While a pot is moved, the hysteresis is small,
+   so sweeps come out in fine steps. Once it has been idle for POTS_IDLE_MS,
+   the hysteresis is raised above the remaining noise, so a pot which isn't
+   touched doesn't report anything. The end values are always reported.
+*/
+
+/////////////////////////////////////////////////////////////////////////////
+// Include files
+/////////////////////////////////////////////////////////////////////////////
+
+#include <mios32.h>
+#include "pots.h"
+
+#define INPUT_SHIFT 3   // 12 bit conversion -> 15 bit filter state
+#define INPUT_BIAS  (1 << (INPUT_SHIFT - 1))    // half an LSB of the conversion
+#define VALUE_MAX   0x3fff
+
+typedef struct
+{
+    u16 reported;   // last reported value (14 bit)
+    u16 anchor;     // value at the end of the last movement
+    u16 idleTime;   // mS since the pot has moved by more than POTS_HYSTERESIS_IDLE
+} potState_t;
+
+static u32 filter[POTS_NUM / 2];    // two 15 bit filter states per word
+static potState_t pots[POTS_NUM];
+static u8 nextIdlePair;             // idle pair which is sampled next
+static u32 numUpdates;              // number of pair updates since the init
+
+static u16 distance(u16 a, u16 b)
+{
+    return (a > b) ? (a - b) : (b - a);
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// scales the 15 bit filter state to 14 bit. The range the filter settles in
+// for a zero input (INPUT_BIAS) ends up at 0, the one for full scale
+// (0x7ff8 + INPUT_BIAS, down to 7 below) at 0x3fff.
+/////////////////////////////////////////////////////////////////////////////
+static u16 scale(u32 state)
+{
+    if (state <= INPUT_BIAS)
+        return 0;
+    state -= INPUT_BIAS;
+    state = (state >> 1) + (state >> 12);
+    return (state > VALUE_MAX) ? VALUE_MAX : state;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// packs two 15 bit values into the halfwords of a word, and averages the
+// halfwords of two words (rounding down)
+/////////////////////////////////////////////////////////////////////////////
+#if __CORTEX_M >= 4
+#define packPair(a, b)      __PKHBT(a, b, 16)
+#define halvingAdd(a, b)    __SHADD16(a, b)
+#else
+#define packPair(a, b)      (((a) & 0xffff) | ((b) << 16))
+#define halvingAdd(a, b)    (((a) & (b)) + ((((a) ^ (b)) >> 1) & 0x7fff7fff))
+#endif
+
+/////////////////////////////////////////////////////////////////////////////
+// returns the conversion results of a pair of pots as 15 bit halfwords
+/////////////////////////////////////////////////////////////////////////////
+static u32 samplePair(int pair)
+{
+    u32 a = MIOS32_AIN_PinGet(POTS_AIN_FIRST + 2*pair);
+    u32 b = MIOS32_AIN_PinGet(POTS_AIN_FIRST + 2*pair + 1);
+    return packPair((a << INPUT_SHIFT) | INPUT_BIAS, (b << INPUT_SHIFT) | INPUT_BIAS);
+}
+
+static u8 isMoving(int pot)
+{
+    return pots[pot].idleTime < POTS_IDLE_MS;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// starts the filter at the current positions of the pots
+/////////////////////////////////////////////////////////////////////////////
+s32 POTS_Init(void)
+{
+    int i;
+    for (i = 0; i < POTS_NUM / 2; i++)
+        filter[i] = samplePair(i);
+
+    for (i = 0; i < POTS_NUM; i++)
+    {
+        pots[i].reported = scale((filter[i >> 1] >> ((i & 1) * 16)) & 0xffff);
+        pots[i].anchor = pots[i].reported;
+        pots[i].idleTime = POTS_IDLE_MS;
+    }
+    nextIdlePair = 0;
+    numUpdates = 0;
+    return 0;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// returns 1 if a pot of an idle pair is further off its filter state than
+// the idle hysteresis
+/////////////////////////////////////////////////////////////////////////////
+static u8 hasMoved(int pair, u32 x)
+{
+    u32 y = filter[pair];
+    return (distance(x & 0xffff, y & 0xffff) > 2 * POTS_HYSTERESIS_IDLE)
+        || (distance(x >> 16, y >> 16) > 2 * POTS_HYSTERESIS_IDLE);
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// filters the moving pots, one pair of idle pots and the idle pots which
+// start to move. Called each mS.
+// returns a bit mask of the pots which report a new value
+/////////////////////////////////////////////////////////////////////////////
+u16 POTS_Update(void)
+{
+    u16 changed = 0;
+    u16 sampled = 0;
+    int i, n, k;
+
+    // the next idle pair in turn
+    for (n = 0; n < POTS_NUM / 2; n++)
+    {
+        i = nextIdlePair;
+        if (++nextIdlePair >= POTS_NUM / 2)
+            nextIdlePair = 0;
+        if (!isMoving(2*i) && !isMoving(2*i + 1))
+        {
+            u32 x = samplePair(i);
+            u32 y = filter[i];
+            for (k = 0; k < POTS_FILTER_IDLE; k++)
+                x = halvingAdd(y, x);
+            filter[i] = x;
+            sampled |= (3 << (2*i));
+            numUpdates++;
+            break;
+        }
+    }
+
+    // all pairs with a moving pot, and the idle ones which start to move
+    for (i = 0; i < POTS_NUM / 2; i++)
+    {
+        if (sampled & (3 << (2*i)))
+            continue;
+        u32 x = samplePair(i);
+        int strength;
+        if (isMoving(2*i) || isMoving(2*i + 1))
+            strength = POTS_FILTER_MOVING;
+        else if (hasMoved(i, x))
+            strength = POTS_FILTER_IDLE;
+        else
+            continue;
+
+        u32 y = filter[i];
+        for (k = 0; k < strength; k++)
+            x = halvingAdd(y, x);
+        filter[i] = x;
+        sampled |= (3 << (2*i));
+        numUpdates++;
+    }
+
+    for (i = 0; i < POTS_NUM; i++)
+    {
+        if (!(sampled & (1 << i)))
+            continue;
+
+        potState_t *p = &pots[i];
+        u16 value = scale((filter[i >> 1] >> ((i & 1) * 16)) & 0xffff);
+
+        if (distance(value, p->anchor) > POTS_HYSTERESIS_IDLE)
+        {
+            p->anchor = value;
+            p->idleTime = 0;
+        }
+        else if (p->idleTime < POTS_IDLE_MS)
+            p->idleTime++; // only counts while the pot is sampled each mS
+
+        u16 hysteresis = (p->idleTime < POTS_IDLE_MS) ? POTS_HYSTERESIS_MOVING : POTS_HYSTERESIS_IDLE;
+        if ((distance(value, p->reported) > hysteresis)
+            || ((value != p->reported) && ((value == 0) || (value == VALUE_MAX))))
+        {
+            p->reported = value;
+            changed |= (1 << i);
+        }
+    }
+    return changed;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// returns the number of pair updates since the init, a measure for the
+// CPU time spent on the pots
+/////////////////////////////////////////////////////////////////////////////
+u32 POTS_UpdatesGet(void)
+{
+    return numUpdates;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// returns the last reported value of a pot (14 bit)
+/////////////////////////////////////////////////////////////////////////////
+u16 POTS_ValueGet(u8 pot)
+{
+    return (pot < POTS_NUM) ? pots[pot].reported : 0;
+}
@@ -0,0 +1,50 @@
+/*
+ * Header file of the potentiometer filter
+ *
+ * ==========================================================================
+ *
+ *  Licensed for personal non-commercial use only.
+ *  All other rights reserved.
+ *
+ * ==========================================================================
+ */
+
+#ifndef _POTS_H
+#define _POTS_H
+
+
+/////////////////////////////////////////////////////////////////////////////
+// Global definitions
+/////////////////////////////////////////////////////////////////////////////
+
+// number of pots (must be even, two pots are filtered with one instruction)
+#define POTS_NUM 12
+
+// AIN pin of the first pot, the others follow consecutively
+#define POTS_AIN_FIRST 0
+
+// low pass strength (y += (x - y) / 2^n) while a pot is moved and while it is
+// idle. Moving pots are filtered each mS, idle pots in turns.
+#define POTS_FILTER_MOVING 2
+#define POTS_FILTER_IDLE   3
+
+// a pot which has moved less than POTS_HYSTERESIS_IDLE for this time (mS)
+// counts as idle
+#define POTS_IDLE_MS 250
+
+// min. change (in 1/16384 of the range) until a new value is reported
+#define POTS_HYSTERESIS_MOVING 8
+#define POTS_HYSTERESIS_IDLE   64
+
+
+/////////////////////////////////////////////////////////////////////////////
+// Prototypes
+/////////////////////////////////////////////////////////////////////////////
+
+extern s32 POTS_Init(void);
+extern u16 POTS_Update(void);
+extern u16 POTS_ValueGet(u8 pot);
+extern u32 POTS_UpdatesGet(void);
+
+
+#endif /* _POTS_H */
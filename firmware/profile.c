@@ -0,0 +1,123 @@
+/* Profiler of the MIOS32 hooks.
+
+   The comments above APP_Tick and APP_MIDI_Tick ask to stay below 300 uS
+   per call. The hooks are measured with the DWT cycle counter, which costs
+   a register read at the begin and a few instructions at the end of each
+   call. Per hook, the number of calls, the min. and max. number of cycles,
+   the calls over the budget and a histogram of the durations are kept.
+   The measured time includes the interrupts which have occurred meanwhile.
+
+   PROFILE_Report() prints the results and the state of the MIDI queues to
+   the MIOS Studio terminal.
+*/
+
+/////////////////////////////////////////////////////////////////////////////
+// Include files
+/////////////////////////////////////////////////////////////////////////////
+
+#include <mios32.h>
+#include "profile.h"
+#include "midi_in.h"
+#include "midi_out.h"
+
+typedef struct
+{
+    u32 calls;
+    u32 minCycles;
+    u32 maxCycles;
+    u32 overruns;
+    u32 histogram[PROFILE_BUCKETS];
+} profileStats_t;
+
+static profileStats_t stats[PROFILE_NUM];
+static u32 cyclesPerUs;
+
+static const char *hookName[PROFILE_NUM] =
+{
+    "APP_Tick",
+    "NOTIFY_MIDI_Rx",
+    "APP_MIDI_NotifyPackage",
+    "APP_DIN_NotifyToggle",
+    "Pots",
+};
+
+/////////////////////////////////////////////////////////////////////////////
+// Initializes the profiler, clears the results
+/////////////////////////////////////////////////////////////////////////////
+s32 PROFILE_Init(void)
+{
+    cyclesPerUs = SystemCoreClock / 1000000;
+
+    int h, i;
+    for (h = 0; h < PROFILE_NUM; h++)
+    {
+        stats[h].calls = 0;
+        stats[h].minCycles = 0xffffffff;
+        stats[h].maxCycles = 0;
+        stats[h].overruns = 0;
+        for (i = 0; i < PROFILE_BUCKETS; i++)
+            stats[h].histogram[i] = 0;
+    }
+    return 0;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// Returns the cycle counter at the begin of a hook
+/////////////////////////////////////////////////////////////////////////////
+u32 PROFILE_Begin(void)
+{
+    return DWT->CYCCNT;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// Counts a call of a hook, begin is the value returned by PROFILE_Begin()
+/////////////////////////////////////////////////////////////////////////////
+void PROFILE_End(profileHook_t hook, u32 begin)
+{
+    u32 cycles = DWT->CYCCNT - begin;
+    profileStats_t *s = &stats[hook];
+
+    s->calls++;
+    if (cycles < s->minCycles)
+        s->minCycles = cycles;
+    if (cycles > s->maxCycles)
+        s->maxCycles = cycles;
+
+    u32 us = cycles / cyclesPerUs;
+    if (us > PROFILE_BUDGET_US)
+        s->overruns++;
+
+    // each bucket covers twice the time of the one before
+    int bucket = 0;
+    for (us >>= 3; us && (bucket < PROFILE_BUCKETS - 1); us >>= 1)
+        bucket++;
+    s->histogram[bucket]++;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// Prints the results to the MIOS Studio terminal
+/////////////////////////////////////////////////////////////////////////////
+s32 PROFILE_Report(void)
+{
+    int h;
+    for (h = 0; h < PROFILE_NUM; h++)
+    {
+        const profileStats_t *s = &stats[h];
+        if (!s->calls)
+        {
+            MIOS32_MIDI_SendDebugMessage("%s: no calls", hookName[h]);
+            continue;
+        }
+        MIOS32_MIDI_SendDebugMessage("%s: %d calls, %d..%d cycles (max. %d uS), %d over %d uS",
+                                     hookName[h], s->calls, s->minCycles, s->maxCycles,
+                                     s->maxCycles / cyclesPerUs, s->overruns, PROFILE_BUDGET_US);
+        MIOS32_MIDI_SendDebugMessage("  <8 uS: %d  <16: %d  <32: %d  <64: %d  <128: %d  <256: %d  <512: %d  more: %d",
+                                     s->histogram[0], s->histogram[1], s->histogram[2], s->histogram[3],
+                                     s->histogram[4], s->histogram[5], s->histogram[6], s->histogram[7]);
+    }
+
+    MIOS32_MIDI_SendDebugMessage("UART0: max. %d bytes queued, %d dropped", MIDI_OUT_HighWaterGet(UART0), MIDI_OUT_DroppedBytesGet(UART0));
+    MIOS32_MIDI_SendDebugMessage("UART1: max. %d bytes queued, %d dropped", MIDI_OUT_HighWaterGet(UART1), MIDI_OUT_DroppedBytesGet(UART1));
+    MIOS32_MIDI_SendDebugMessage("Sync events lost: %d", MIDI_IN_OverrunsGet());
+    return 0;
+}
@@ -0,0 +1,52 @@
+/*
+ * Header file of the hook profiler
+ *
+ * ==========================================================================
+ *
+ *  Licensed for personal non-commercial use only.
+ *  All other rights reserved.
+ *
+ * ==========================================================================
+ */
+
+#ifndef _PROFILE_H
+#define _PROFILE_H
+
+
+/////////////////////////////////////////////////////////////////////////////
+// Global definitions
+/////////////////////////////////////////////////////////////////////////////
+
+// calls which take longer are counted as overruns (uS)
+#define PROFILE_BUDGET_US 300
+
+// histogram buckets: < 8 uS, < 16 uS, < 32 uS ... >= 512 uS
+#define PROFILE_BUCKETS 8
+
+
+/////////////////////////////////////////////////////////////////////////////
+// Global Types
+/////////////////////////////////////////////////////////////////////////////
+
+typedef enum
+{
+    profileTick = 0,        // APP_Tick
+    profileMidiRx,          // NOTIFY_MIDI_Rx
+    profileMidiPackage,     // APP_MIDI_NotifyPackage
+    profileDin,             // APP_DIN_NotifyToggle
+    profilePots,            // the pots, sampled in APP_Tick
+    PROFILE_NUM
+} profileHook_t;
+
+
+/////////////////////////////////////////////////////////////////////////////
+// Prototypes
+/////////////////////////////////////////////////////////////////////////////
+
+extern s32 PROFILE_Init(void);
+extern u32 PROFILE_Begin(void);
+extern void PROFILE_End(profileHook_t hook, u32 begin);
+extern s32 PROFILE_Report(void);
+
+
+#endif /* _PROFILE_H */
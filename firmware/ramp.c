@@ -0,0 +1,173 @@
+/* Clock synced ramps for the performance macros.
+
+   A ramp moves a macro from its current value to a target over a number of
+   clock ticks. It advances by one step on each clock tick of the sync
+   source, so it follows the tempo and a ramp of 96 ticks lasts exactly one
+   4/4 bar. Each tick yields one new value per running ramp, the load on the
+   UART is spread evenly over the whole ramp instead of sending everything
+   in one go.
+
+   The shape maps the position in the ramp (15 bit fraction) to the part of
+   the change which has been made:
+        linear:  y = x
+        curved:  y = x^2            (a kill sweeps down slowly, then drops)
+        S-curve: y = x^2 (3 - 2x)   (smoothstep)
+*/
+
+/////////////////////////////////////////////////////////////////////////////
+// Include files
+/////////////////////////////////////////////////////////////////////////////
+
+#include <mios32.h>
+#include "ramp.h"
+
+#define FRACTION_BITS 15
+#define ONE           (1 << FRACTION_BITS)
+
+typedef struct
+{
+    u16 from;
+    u16 to;
+    u16 length;     // in clock ticks
+    u16 position;   // clock ticks since the start
+    u16 value;      // current value (14 bit)
+    rampShape_t shape;
+} ramp_t;
+
+static ramp_t ramps[RAMP_NUM];
+static u16 active;  // bit flags: the ramp is running
+
+/////////////////////////////////////////////////////////////////////////////
+// returns the part of the change made at the position x (both 0..ONE)
+/////////////////////////////////////////////////////////////////////////////
+static u32 shapeOf(rampShape_t shape, u32 x)
+{
+    switch (shape)
+    {
+        case rampCurved:
+            return (x * x) >> FRACTION_BITS;
+        case rampSCurve:
+            return (((x * x) >> FRACTION_BITS) * (3 * ONE - 2 * x)) >> FRACTION_BITS;
+        default:
+            return x;
+    }
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// Initializes the ramps, none is running
+/////////////////////////////////////////////////////////////////////////////
+s32 RAMP_Init(void)
+{
+    int i;
+    for (i = 0; i < RAMP_NUM; i++)
+        ramps[i].value = 0;
+    active = 0;
+    return 0;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// Starts a ramp from the value 'from' to 'to' over 'ticks' clock ticks. A
+// ramp which is already running is replaced. The first step is made on the
+// next clock tick.
+/////////////////////////////////////////////////////////////////////////////
+s32 RAMP_Start(u8 ramp, u16 from, u16 to, u16 ticks, rampShape_t shape)
+{
+    if (ramp >= RAMP_NUM)
+        return -1;
+
+    ramp_t *r = &ramps[ramp];
+    r->from = from;
+    r->to = to;
+    r->length = ticks ? ticks : 1;
+    r->position = 0;
+    r->value = from;
+    r->shape = shape;
+    active |= (1 << ramp);
+    return 0;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// Stops a ramp at its current value
+/////////////////////////////////////////////////////////////////////////////
+s32 RAMP_Stop(u8 ramp)
+{
+    if (ramp >= RAMP_NUM)
+        return -1;
+
+    active &= ~(1 << ramp);
+    return 0;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// Advances all running ramps by one clock tick. Returns the bit flags of
+// the ramps whose value has changed.
+/////////////////////////////////////////////////////////////////////////////
+u16 RAMP_Tick(void)
+{
+    u16 changed = 0;
+    int i;
+    for (i = 0; i < RAMP_NUM; i++)
+    {
+        if (!(active & (1 << i)))
+            continue;
+
+        ramp_t *r = &ramps[i];
+        u16 value;
+        if (++r->position >= r->length)
+        {
+            value = r->to;
+            active &= ~(1 << i);
+        }
+        else
+        {
+            u32 y = shapeOf(r->shape, ((u32)r->position << FRACTION_BITS) / r->length);
+            value = r->from + (((s32)r->to - (s32)r->from) * (s32)y) / ONE;
+        }
+
+        if (value != r->value)
+        {
+            r->value = value;
+            changed |= (1 << i);
+        }
+    }
+    return changed;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// Lets all running ramps jump to their targets (e.g. when the clock has
+// stopped). Returns the bit flags of the ramps whose value has changed.
+/////////////////////////////////////////////////////////////////////////////
+u16 RAMP_Finish(void)
+{
+    u16 changed = 0;
+    int i;
+    for (i = 0; i < RAMP_NUM; i++)
+    {
+        if (!(active & (1 << i)))
+            continue;
+
+        if (ramps[i].value != ramps[i].to)
+        {
+            ramps[i].value = ramps[i].to;
+            changed |= (1 << i);
+        }
+    }
+    active = 0;
+    return changed;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// Returns the current value of a ramp
+/////////////////////////////////////////////////////////////////////////////
+u16 RAMP_ValueGet(u8 ramp)
+{
+    return (ramp < RAMP_NUM) ? ramps[ramp].value : 0;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// Returns the bit flags of the running ramps
+/////////////////////////////////////////////////////////////////////////////
+u16 RAMP_ActiveGet(void)
+{
+    return active;
+}
@@ -0,0 +1,49 @@
+/*
+ * Header file of the clock synced macro ramps
+ *
+ * ==========================================================================
+ *
+ *  Licensed for personal non-commercial use only.
+ *  All other rights reserved.
+ *
+ * ==========================================================================
+ */
+
+#ifndef _RAMP_H
+#define _RAMP_H
+
+
+/////////////////////////////////////////////////////////////////////////////
+// Global definitions
+/////////////////////////////////////////////////////////////////////////////
+
+// number of ramps (one per performance macro)
+#define RAMP_NUM 12
+
+
+/////////////////////////////////////////////////////////////////////////////
+// Global Types
+/////////////////////////////////////////////////////////////////////////////
+
+typedef enum
+{
+    rampLinear = 0,
+    rampCurved = 1,     // starts slowly, most of the change happens at the end
+    rampSCurve = 2      // starts and ends slowly
+} rampShape_t;
+
+
+/////////////////////////////////////////////////////////////////////////////
+// Prototypes
+/////////////////////////////////////////////////////////////////////////////
+
+extern s32 RAMP_Init(void);
+extern s32 RAMP_Start(u8 ramp, u16 from, u16 to, u16 ticks, rampShape_t shape);
+extern s32 RAMP_Stop(u8 ramp);
+extern u16 RAMP_Tick(void);
+extern u16 RAMP_Finish(void);
+extern u16 RAMP_ValueGet(u8 ramp);
+extern u16 RAMP_ActiveGet(void);
+
+
+#endif /* _RAMP_H */
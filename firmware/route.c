@@ -0,0 +1,99 @@
+/* MIDI routing matrix.
+
+   Each source port has a filter per destination port. Checking the filters
+   for each received package would cost a loop over the destinations with
+   several tests each, so the filters are compiled into lookup tables
+   instead: per source, the package type, the channel and the CC number each
+   select the set of destinations they pass to. The destinations of a
+   package are the intersection of those sets, two or three table lookups.
+
+   The tables are only rebuilt when the filters change.
+*/
+
+/////////////////////////////////////////////////////////////////////////////
+// Include files
+/////////////////////////////////////////////////////////////////////////////
+
+#include <mios32.h>
+#include "route.h"
+
+// destination flags per source and package type, channel and CC number
+static u8 typeDestinations[ROUTE_NUM_PORTS][16];
+static u8 channelDestinations[ROUTE_NUM_PORTS][16];
+static u8 ccDestinations[ROUTE_NUM_PORTS][128];
+
+/////////////////////////////////////////////////////////////////////////////
+// returns the index of a port in the matrix, -1 if it is not routed
+/////////////////////////////////////////////////////////////////////////////
+static int portIndex(mios32_midi_port_t port)
+{
+    switch (port)
+    {
+        case USB0:  return 0;
+        case UART0: return 1;
+        case UART1: return 2;
+        default:    return -1;
+    }
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// Initializes the matrix, nothing is routed
+/////////////////////////////////////////////////////////////////////////////
+s32 ROUTE_Init(void)
+{
+    int s, i;
+    for (s = 0; s < ROUTE_NUM_PORTS; s++)
+    {
+        for (i = 0; i < 16; i++)
+            typeDestinations[s][i] = channelDestinations[s][i] = 0;
+        for (i = 0; i < 128; i++)
+            ccDestinations[s][i] = 0;
+    }
+    return 0;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// Compiles the filters into the lookup tables. filter[source][destination]
+/////////////////////////////////////////////////////////////////////////////
+s32 ROUTE_Compile(const routeFilter_t filter[ROUTE_NUM_PORTS][ROUTE_NUM_PORTS])
+{
+    ROUTE_Init();
+
+    int s, d, i;
+    for (s = 0; s < ROUTE_NUM_PORTS; s++)
+    {
+        for (d = 0; d < ROUTE_NUM_PORTS; d++)
+        {
+            const routeFilter_t *f = &filter[s][d];
+            for (i = 0; i < 16; i++)
+            {
+                if (f->types & (1 << i))
+                    typeDestinations[s][i] |= 1 << d;
+                if (f->channels & (1 << i))
+                    channelDestinations[s][i] |= 1 << d;
+            }
+            for (i = f->ccFirst; (i <= f->ccLast) && (i < 128); i++)
+                ccDestinations[s][i] |= 1 << d;
+        }
+    }
+    return 0;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// Returns the destination flags of a package received at a port
+/////////////////////////////////////////////////////////////////////////////
+u8 ROUTE_Destinations(mios32_midi_port_t source, mios32_midi_package_t package)
+{
+    int s = portIndex(source);
+    if (s < 0)
+        return 0;
+
+    u8 destinations = typeDestinations[s][package.type];
+    if ((package.type >= NoteOff) && (package.type <= PitchBend))
+    {
+        destinations &= channelDestinations[s][package.chn];
+        if (package.type == CC)
+            destinations &= ccDestinations[s][package.cc_number];
+    }
+    return destinations;
+}
@@ -0,0 +1,59 @@
+/*
+ * Header file of the MIDI routing matrix
+ *
+ * ==========================================================================
+ *
+ *  Licensed for personal non-commercial use only.
+ *  All other rights reserved.
+ *
+ * ==========================================================================
+ */
+
+#ifndef _ROUTE_H
+#define _ROUTE_H
+
+
+/////////////////////////////////////////////////////////////////////////////
+// Global definitions
+/////////////////////////////////////////////////////////////////////////////
+
+// ports of the matrix: USB0, UART0 (MIDI 1) and UART1 (MIDI 2, the Rytm)
+#define ROUTE_NUM_PORTS 3
+
+// destination flags
+#define ROUTE_USB0  0x01
+#define ROUTE_UART0 0x02
+#define ROUTE_UART1 0x04
+
+// package types (CIN) of the filters
+#define ROUTE_TYPES_ALL      0xffff
+#define ROUTE_TYPES_SYSEX    ((1 << 0x4) | (1 << 0x5) | (1 << 0x6) | (1 << 0x7))
+#define ROUTE_TYPES_SYSTEM   ((1 << 0x2) | (1 << 0x3) | (1 << 0xf)) // system common and realtime
+#define ROUTE_TYPES_CHANNEL  0x7f00
+
+
+/////////////////////////////////////////////////////////////////////////////
+// Global Types
+/////////////////////////////////////////////////////////////////////////////
+
+// the filter of one route. A package passes if its type is enabled and, for
+// channel messages, its channel and, for CCs, its CC number.
+typedef struct __attribute__((packed))
+{
+    u16 types;      // bit flags of the package types (CIN)
+    u16 channels;   // bit flags of the channels
+    u8 ccFirst;     // range of the CC numbers
+    u8 ccLast;
+} routeFilter_t;
+
+
+/////////////////////////////////////////////////////////////////////////////
+// Prototypes
+/////////////////////////////////////////////////////////////////////////////
+
+extern s32 ROUTE_Init(void);
+extern s32 ROUTE_Compile(const routeFilter_t filter[ROUTE_NUM_PORTS][ROUTE_NUM_PORTS]);
+extern u8 ROUTE_Destinations(mios32_midi_port_t source, mios32_midi_package_t package);
+
+
+#endif /* _ROUTE_H */
@@ -0,0 +1,228 @@
+/* Parser for the settings dump of the Rytm.
+
+   At power-on the controller doesn't know which tracks are muted and which
+   scene is active on the Rytm. It requests the settings dump, which holds
+   both, and parses the reply as the SysEx packages arrive, without storing
+   the message.
+
+   A dump looks like this:
+
+        F0 00 20 3C 07 <dev> <id> <ver> <ver> <obj>  payload  <chk> <chk> <len> <len> F7
+
+   The payload is 7 bit packed: each group of up to 7 bytes is preceded by
+   a byte which holds their MSBs (bit 6 belongs to the first byte). The
+   checksum is the 14 bit sum of the payload bytes, the length counts the
+   payload plus 5. As the end of the payload is only known with the F7,
+   the last 4 bytes are held back in a small delay line, so the trailer is
+   never decoded as payload. The decoded values are only taken over once
+   the checksum and the length match.
+*/
+
+/////////////////////////////////////////////////////////////////////////////
+// Include files
+/////////////////////////////////////////////////////////////////////////////
+
+#include <mios32.h>
+#include "midi_out.h"
+#include "rytm_dump.h"
+
+// header after the F0, ANY matches any byte
+#define ANY 0xff
+static const u8 header[] = { 0x00, 0x20, 0x3c, 0x07, ANY, RYTM_DUMP_SETTINGS, ANY, ANY, ANY };
+
+// position in the header, IDLE outside of a dump
+#define IDLE 0xff
+static u8 headerPos;
+
+static u8 delay[4];     // the last 4 bytes received
+static u16 received;    // bytes after the header
+static u16 sum;         // checksum of the payload
+static u8 msbs;
+static u16 decodedPos;  // position in the decoded object
+
+static u16 dumpMutes;   // values of the dump in progress
+static s8 dumpScene;
+
+static u16 mutes;       // values of the last valid dump
+static s8 scene;
+
+/////////////////////////////////////////////////////////////////////////////
+// decodes one byte of the payload
+/////////////////////////////////////////////////////////////////////////////
+static void decode(u8 b)
+{
+    sum += b;
+    u16 packedPos = received - 4;
+    if ((packedPos & 7) == 0)
+    {
+        msbs = b;
+        return;
+    }
+
+    b |= (msbs << (packedPos & 7)) & 0x80;
+    if (decodedPos == RYTM_DUMP_MUTES_OFFSET)
+        dumpMutes = b << 8;
+    else if (decodedPos == RYTM_DUMP_MUTES_OFFSET + 1)
+        dumpMutes |= b;
+    else if (decodedPos == RYTM_DUMP_SCENE_OFFSET)
+        dumpScene = (b <= 12) ? b : 0;
+    decodedPos++;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// checks the trailer. Returns 1 if the dump is valid.
+/////////////////////////////////////////////////////////////////////////////
+static s32 finish(void)
+{
+    if (received < 4)
+        return 0;
+
+    // the oldest byte of the delay line is the next one to be overwritten
+    u8 i = received & 3;
+    u16 checksum = (delay[i] << 7) | delay[(i + 1) & 3];
+    u16 length = (delay[(i + 2) & 3] << 7) | delay[(i + 3) & 3];
+    if ((checksum != (sum & 0x3fff)) || (length != received - 4 + 5))
+        return 0;
+
+    // the dump must reach the values
+    if ((decodedPos <= RYTM_DUMP_MUTES_OFFSET + 1) || (decodedPos <= RYTM_DUMP_SCENE_OFFSET))
+        return 0;
+
+    mutes = dumpMutes;
+    scene = dumpScene;
+    return 1;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// feeds one byte into the parser. Returns 1 if a valid dump has been
+// completed.
+/////////////////////////////////////////////////////////////////////////////
+static s32 parseByte(u8 b)
+{
+    if (b >= 0xf8)
+        return 0; // realtime messages may be interleaved
+
+    if (b == 0xf0)
+    {
+        headerPos = 0;
+        return 0;
+    }
+    if (headerPos == IDLE)
+        return 0;
+
+    if (b == 0xf7)
+    {
+        s32 status = (headerPos == sizeof(header)) ? finish() : 0;
+        headerPos = IDLE;
+        return status;
+    }
+    if (b >= 0x80)
+    {
+        headerPos = IDLE; // any other status byte ends the SysEx
+        return 0;
+    }
+
+    if (headerPos < sizeof(header))
+    {
+        if ((header[headerPos] != ANY) && (header[headerPos] != b))
+        {
+            headerPos = IDLE; // not a settings dump
+            return 0;
+        }
+        if (++headerPos == sizeof(header))
+        {
+            received = 0;
+            sum = 0;
+            decodedPos = 0;
+            dumpMutes = 0;
+            dumpScene = 0;
+        }
+        return 0;
+    }
+
+    // the bytes leave the delay line 4 bytes later
+    u8 i = received & 3;
+    if (received >= 4)
+        decode(delay[i]);
+    delay[i] = b;
+    received++;
+    return 0;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// Initializes the parser
+/////////////////////////////////////////////////////////////////////////////
+s32 RYTM_DUMP_Init(void)
+{
+    headerPos = IDLE;
+    mutes = 0;
+    scene = 0;
+    return 0;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// Sends the request for the settings dump
+/////////////////////////////////////////////////////////////////////////////
+s32 RYTM_DUMP_Request(mios32_midi_port_t port)
+{
+    static const u8 request[] = { 0xf0, 0x00, 0x20, 0x3c, 0x07, 0x00, RYTM_DUMP_SETTINGS_REQUEST,
+                                  0x01, 0x01, 0x00, 0x00, 0x00, 0x00, 0x05, 0xf7 };
+
+    // 3 bytes per package, the last one ends the SysEx
+    int i;
+    for (i = 0; i < sizeof(request); i += 3)
+    {
+        int len = sizeof(request) - i;
+        mios32_midi_package_t package;
+        package.ALL = 0;
+        package.type = (len > 3) ? 0x4 : 0x4 + len;
+        package.evnt0 = request[i];
+        package.evnt1 = (len > 1) ? request[i + 1] : 0;
+        package.evnt2 = (len > 2) ? request[i + 2] : 0;
+        MIDI_OUT_SendPackage(port, package);
+    }
+    return 0;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// Parses a package received from the Rytm. Returns 1 if it has completed
+// a valid settings dump.
+/////////////////////////////////////////////////////////////////////////////
+s32 RYTM_DUMP_Parse(mios32_midi_package_t package)
+{
+    u8 len;
+    switch (package.type)
+    {
+        case 0x4: len = 3; break;   // SysEx starts or continues
+        case 0x5: len = 1; break;   // SysEx ends with 1 byte, or single byte system common
+        case 0x6: len = 2; break;
+        case 0x7: len = 3; break;
+        case 0xf: len = 1; break;   // single byte
+        default:
+            headerPos = IDLE;       // channel messages end the SysEx
+            return 0;
+    }
+
+    s32 status = parseByte(package.evnt0);
+    if (len >= 2)
+        status |= parseByte(package.evnt1);
+    if (len >= 3)
+        status |= parseByte(package.evnt2);
+    return status;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// Returns the track mutes of the last valid dump (bit flags)
+/////////////////////////////////////////////////////////////////////////////
+u16 RYTM_DUMP_MutesGet(void)
+{
+    return mutes;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// Returns the scene of the last valid dump (0 == off)
+/////////////////////////////////////////////////////////////////////////////
+s8 RYTM_DUMP_SceneGet(void)
+{
+    return scene;
+}
@@ -0,0 +1,41 @@
+/*
+ * Header file of the parser for the settings dump of the Rytm
+ *
+ * ==========================================================================
+ *
+ *  Licensed for personal non-commercial use only.
+ *  All other rights reserved.
+ *
+ * ==========================================================================
+ */
+
+#ifndef _RYTM_DUMP_H
+#define _RYTM_DUMP_H
+
+
+/////////////////////////////////////////////////////////////////////////////
+// Global definitions
+/////////////////////////////////////////////////////////////////////////////
+
+// SysEx IDs of the settings dump and of its request
+#define RYTM_DUMP_SETTINGS         0x56
+#define RYTM_DUMP_SETTINGS_REQUEST 0x66
+
+// positions in the decoded settings object. They depend on the OS version
+// of the Rytm.
+#define RYTM_DUMP_MUTES_OFFSET     0x0e    // 2 bytes, MSB first, bit 0 == track 1
+#define RYTM_DUMP_SCENE_OFFSET     0x14    // 0 == off, 1..12
+
+
+/////////////////////////////////////////////////////////////////////////////
+// Prototypes
+/////////////////////////////////////////////////////////////////////////////
+
+extern s32 RYTM_DUMP_Init(void);
+extern s32 RYTM_DUMP_Request(mios32_midi_port_t port);
+extern s32 RYTM_DUMP_Parse(mios32_midi_package_t package);
+extern u16 RYTM_DUMP_MutesGet(void);
+extern s8 RYTM_DUMP_SceneGet(void);
+
+
+#endif /* _RYTM_DUMP_H */
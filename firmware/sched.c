@@ -0,0 +1,166 @@
+/* Scheduler for actions at future clock ticks.
+
+   The events are kept in a hashed timer wheel: slot n holds the events
+   which are due at a tick t with t % SCHED_SLOTS == n. An event which is
+   more than SCHED_SLOTS ticks away additionally counts the turns of the
+   wheel it still has to wait. Inserting and cancelling an event is O(1),
+   a clock tick only visits the events in one slot, so any number of
+   queued events doesn't add to the cost of the ticks they aren't due on.
+
+   Due events are moved to a list in the order they have been inserted and
+   are taken from there with SCHED_Pop. The events live in a fixed pool,
+   all lists are doubly linked by the index of the event.
+*/
+
+/////////////////////////////////////////////////////////////////////////////
+// Include files
+/////////////////////////////////////////////////////////////////////////////
+
+#include <mios32.h>
+#include "sched.h"
+
+#define NONE      0xff
+#define LIST_DUE  SCHED_SLOTS
+#define LIST_FREE (SCHED_SLOTS + 1)
+#define NUM_LISTS (SCHED_SLOTS + 2)
+
+typedef struct
+{
+    schedEvent_t event;
+    u16 turns;  // remaining turns of the wheel
+    u16 list;   // slot, LIST_DUE or LIST_FREE
+    u8 prev;
+    u8 next;
+} entry_t;
+
+static entry_t entries[SCHED_EVENTS];
+static u8 head[NUM_LISTS];
+static u8 tail[NUM_LISTS];
+static u32 now;     // clock ticks since the init
+
+static void listAppend(u16 list, u8 e)
+{
+    entries[e].list = list;
+    entries[e].prev = tail[list];
+    entries[e].next = NONE;
+    if (tail[list] == NONE)
+        head[list] = e;
+    else
+        entries[tail[list]].next = e;
+    tail[list] = e;
+}
+
+static void listRemove(u8 e)
+{
+    entry_t *entry = &entries[e];
+    if (entry->prev == NONE)
+        head[entry->list] = entry->next;
+    else
+        entries[entry->prev].next = entry->next;
+    if (entry->next == NONE)
+        tail[entry->list] = entry->prev;
+    else
+        entries[entry->next].prev = entry->prev;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// Initializes the wheel, no event is scheduled
+/////////////////////////////////////////////////////////////////////////////
+s32 SCHED_Init(void)
+{
+    int i;
+    for (i = 0; i < NUM_LISTS; i++)
+        head[i] = tail[i] = NONE;
+    for (i = 0; i < SCHED_EVENTS; i++)
+        listAppend(LIST_FREE, i);
+    now = 0;
+    return 0;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// Schedules an event 'ticks' clock ticks from now (min. 1). Returns the
+// handle of the event or -1 if all events are in use.
+/////////////////////////////////////////////////////////////////////////////
+s32 SCHED_Insert(u32 ticks, u8 action, u16 param)
+{
+    u8 e = head[LIST_FREE];
+    if (e == NONE)
+        return -1;
+    if (!ticks)
+        ticks = 1;
+
+    listRemove(e);
+    entries[e].event.action = action;
+    entries[e].event.param = param;
+    entries[e].turns = (ticks - 1) / SCHED_SLOTS;
+    listAppend((now + ticks) & (SCHED_SLOTS - 1), e);
+    return e;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// Removes a scheduled event, also if it is due but hasn't been popped yet
+/////////////////////////////////////////////////////////////////////////////
+s32 SCHED_Cancel(s32 handle)
+{
+    if ((handle < 0) || (handle >= SCHED_EVENTS) || (entries[handle].list == LIST_FREE))
+        return -1;
+
+    listRemove(handle);
+    listAppend(LIST_FREE, handle);
+    return 0;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// Returns the number of clock ticks until an event is due (0 if it is due)
+/////////////////////////////////////////////////////////////////////////////
+u32 SCHED_TicksLeft(s32 handle)
+{
+    if ((handle < 0) || (handle >= SCHED_EVENTS) || (entries[handle].list >= SCHED_SLOTS))
+        return 0;
+
+    u32 ticks = (entries[handle].list - now) & (SCHED_SLOTS - 1);
+    if (!ticks)
+        ticks = SCHED_SLOTS;
+    return ticks + entries[handle].turns * SCHED_SLOTS;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// Advances the wheel by one clock tick. Returns the number of events which
+// have become due.
+/////////////////////////////////////////////////////////////////////////////
+s32 SCHED_Tick(void)
+{
+    now++;
+    u16 slot = now & (SCHED_SLOTS - 1);
+    s32 due = 0;
+    u8 e = head[slot];
+    while (e != NONE)
+    {
+        u8 next = entries[e].next;
+        if (entries[e].turns)
+            entries[e].turns--;
+        else
+        {
+            listRemove(e);
+            listAppend(LIST_DUE, e);
+            due++;
+        }
+        e = next;
+    }
+    return due;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// Takes the next due event. Returns 1 if there was one, 0 if not.
+/////////////////////////////////////////////////////////////////////////////
+s32 SCHED_Pop(schedEvent_t *event)
+{
+    u8 e = head[LIST_DUE];
+    if (e == NONE)
+        return 0;
+
+    *event = entries[e].event;
+    listRemove(e);
+    listAppend(LIST_FREE, e);
+    return 1;
+}
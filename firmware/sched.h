@@ -0,0 +1,51 @@
+/*
+ * Header file of the clock tick scheduler
+ *
+ * ==========================================================================
+ *
+ *  Licensed for personal non-commercial use only.
+ *  All other rights reserved.
+ *
+ * ==========================================================================
+ */
+
+#ifndef _SCHED_H
+#define _SCHED_H
+
+
+/////////////////////////////////////////////////////////////////////////////
+// Global definitions
+/////////////////////////////////////////////////////////////////////////////
+
+// number of slots of the timer wheel (must be a power of 2). Events which
+// are further away wrap around and wait for the according number of turns.
+#define SCHED_SLOTS 128
+
+// max. number of scheduled events
+#define SCHED_EVENTS 32
+
+
+/////////////////////////////////////////////////////////////////////////////
+// Global Types
+/////////////////////////////////////////////////////////////////////////////
+
+typedef struct
+{
+    u8 action;  // meaning is up to the application
+    u16 param;
+} schedEvent_t;
+
+
+/////////////////////////////////////////////////////////////////////////////
+// Prototypes
+/////////////////////////////////////////////////////////////////////////////
+
+extern s32 SCHED_Init(void);
+extern s32 SCHED_Insert(u32 ticks, u8 action, u16 param);
+extern s32 SCHED_Cancel(s32 handle);
+extern u32 SCHED_TicksLeft(s32 handle);
+extern s32 SCHED_Tick(void);
+extern s32 SCHED_Pop(schedEvent_t *event);
+
+
+#endif /* _SCHED_H */
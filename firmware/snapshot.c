@@ -0,0 +1,141 @@
+/* Snapshot memory in the BankStick.
+
+   Each slot holds the mute states, the scene, the performance kill state
+   and the values of the macros. A slot is written with one page write of
+   the EEPROM, the BankStick takes a few mS to program it and doesn't
+   answer meanwhile.
+
+   The store and the recall are made from the DIN hook which holds the
+   state mutex, so they must not wait for the BankStick. All slots are read
+   into RAM on the init; a store only updates the copy in RAM and marks the
+   slot as dirty, a recall reads the copy. SNAPSHOT_Background() is called
+   from the background task and writes one dirty slot at a time once the
+   BankStick has finished the previous write.
+
+   A slot which has never been written reads as 0xff and is recognized by
+   its missing magic byte. Slots stored before the second target had been
+   added carry MAGIC_ONE_TARGET; they only hold the state of the first
+   target, the second one is loaded as unknown.
+*/
+
+/////////////////////////////////////////////////////////////////////////////
+// Include files
+/////////////////////////////////////////////////////////////////////////////
+
+#include <mios32.h>
+#include "snapshot.h"
+
+#define MAGIC            0x5b
+#define MAGIC_ONE_TARGET 0x5a
+
+// max. number of polls while the BankStick is still programming (only on
+// the init)
+#define WRITE_POLLS 10000
+
+static u8 available;
+
+// copies of the slots, and the ones which still have to be written
+static snapshot_t slots[SNAPSHOT_NUM];
+static volatile u16 dirtySlots;
+
+/////////////////////////////////////////////////////////////////////////////
+// waits until the BankStick has finished the last write. Returns < 0 if
+// it doesn't respond.
+/////////////////////////////////////////////////////////////////////////////
+static s32 waitWriteFinished(void)
+{
+    int i;
+    for (i = 0; i < WRITE_POLLS; i++)
+    {
+        s32 status = MIOS32_IIC_BS_CheckWriteFinished(SNAPSHOT_BANKSTICK);
+        if (status <= 0)
+            return status;
+    }
+    return -1;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// Initializes the BankStick and reads all slots. Returns < 0 if it is not
+// connected.
+/////////////////////////////////////////////////////////////////////////////
+s32 SNAPSHOT_Init(void)
+{
+    MIOS32_IIC_BS_Init(0);
+    available = MIOS32_IIC_BS_CheckAvailable(SNAPSHOT_BANKSTICK) > 0;
+    dirtySlots = 0;
+    if (available && (waitWriteFinished() < 0))
+        available = 0;
+    int slot;
+    for (slot = 0; available && (slot < SNAPSHOT_NUM); slot++)
+        if (MIOS32_IIC_BS_Read(SNAPSHOT_BANKSTICK, SNAPSHOT_ADDRESS + slot * SNAPSHOT_SLOT_SIZE,
+                               (u8 *)&slots[slot], sizeof(snapshot_t)) < 0)
+            available = 0;
+    return available ? 0 : -1;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// Stores a snapshot in a slot. It is written to the BankStick later by
+// SNAPSHOT_Background(). Returns < 0 on errors.
+/////////////////////////////////////////////////////////////////////////////
+s32 SNAPSHOT_Store(u8 slot, snapshot_t *snapshot)
+{
+    if (!available || (slot >= SNAPSHOT_NUM))
+        return -1;
+
+    snapshot->magic = MAGIC;
+    MIOS32_IRQ_Disable();
+    slots[slot] = *snapshot;
+    dirtySlots |= (1 << slot);
+    MIOS32_IRQ_Enable();
+    return 0;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// Writes a dirty slot to the BankStick if it has finished the previous
+// write, doesn't wait otherwise. Called from the background task. Returns
+// the number of the slot which failed to be written + 1, 0 otherwise.
+/////////////////////////////////////////////////////////////////////////////
+s32 SNAPSHOT_Background(void)
+{
+    if (!dirtySlots)
+        return 0;
+    if (MIOS32_IIC_BS_CheckWriteFinished(SNAPSHOT_BANKSTICK) != 0)
+        return 0; // still programming, or the bus is busy: try again on the next call
+
+    // a copy is written, the slot may be stored again meanwhile and is
+    // then marked as dirty again
+    u8 slot = 0;
+    while (!(dirtySlots & (1 << slot)))
+        slot++;
+    snapshot_t snapshot;
+    MIOS32_IRQ_Disable();
+    snapshot = slots[slot];
+    dirtySlots &= ~(1 << slot);
+    MIOS32_IRQ_Enable();
+
+    if (MIOS32_IIC_BS_Write(SNAPSHOT_BANKSTICK, SNAPSHOT_ADDRESS + slot * SNAPSHOT_SLOT_SIZE,
+                            (u8 *)&snapshot, sizeof(snapshot_t)) < 0)
+        return slot + 1;
+    return 0;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// Reads the snapshot of a slot. Returns -1 if there is no BankStick or on
+// errors, -2 if the slot is empty.
+/////////////////////////////////////////////////////////////////////////////
+s32 SNAPSHOT_Load(u8 slot, snapshot_t *snapshot)
+{
+    if (!available || (slot >= SNAPSHOT_NUM))
+        return -1;
+    MIOS32_IRQ_Disable();
+    *snapshot = slots[slot];
+    MIOS32_IRQ_Enable();
+
+    if (snapshot->magic == MAGIC_ONE_TARGET)
+    {
+        snapshot->scene2 = -1;
+        snapshot->trackMutes2 = SNAPSHOT_MUTES_UNKNOWN;
+        return 0;
+    }
+    return (snapshot->magic == MAGIC) ? 0 : -2;
+}
@@ -0,0 +1,62 @@
+/*
+ * Header file of the snapshot memory
+ *
+ * ==========================================================================
+ *
+ *  Licensed for personal non-commercial use only.
+ *  All other rights reserved.
+ *
+ * ==========================================================================
+ */
+
+#ifndef _SNAPSHOT_H
+#define _SNAPSHOT_H
+
+
+/////////////////////////////////////////////////////////////////////////////
+// Global definitions
+/////////////////////////////////////////////////////////////////////////////
+
+// number of snapshot slots
+#define SNAPSHOT_NUM 12
+
+// BankStick and address the slots are stored at
+#define SNAPSHOT_BANKSTICK 0
+#define SNAPSHOT_ADDRESS   0x0000
+
+// bytes reserved per slot (a slot must not cross a 64 byte page)
+#define SNAPSHOT_SLOT_SIZE 32
+
+
+/////////////////////////////////////////////////////////////////////////////
+// Global Types
+/////////////////////////////////////////////////////////////////////////////
+
+// the scene and the track mutes are kept for two targets. The fields of
+// the second one have been added in the free bytes of the slot.
+typedef struct __attribute__((packed))
+{
+    u8 magic;           // marks a stored slot
+    u8 performanceKill;
+    s8 scene;           // of the first target, -1 == none
+    s8 scene2;          // of the second target
+    u16 trackMutes;     // bit flags, of the first target
+    u16 macros[12];     // 14 bit values of the performance macros
+    u16 trackMutes2;    // of the second target, SNAPSHOT_MUTES_UNKNOWN == not stored
+} snapshot_t;
+
+// track mutes of a target which are not part of the snapshot
+#define SNAPSHOT_MUTES_UNKNOWN 0xffff
+
+
+/////////////////////////////////////////////////////////////////////////////
+// Prototypes
+/////////////////////////////////////////////////////////////////////////////
+
+extern s32 SNAPSHOT_Init(void);
+extern s32 SNAPSHOT_Store(u8 slot, snapshot_t *snapshot);
+extern s32 SNAPSHOT_Background(void);
+extern s32 SNAPSHOT_Load(u8 slot, snapshot_t *snapshot);
+
+
+#endif /* _SNAPSHOT_H */
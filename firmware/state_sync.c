@@ -0,0 +1,142 @@
+/* State sync protocol for editors and mirror panels on the computer.
+
+   A panel subscribes by sending F0 7D 52 43 04 F7 on USB0. The controller
+   answers with the full state in one frame and from then on only sends the
+   fields which have changed:
+
+        full:   F0 7D 52 43 10 <version> <seq> <count> <count bytes> F7
+        delta:  F0 7D 52 43 11 <version> <seq> <field> <value> ... F7
+
+   The fields are laid out in state_sync.h. seq counts the frames modulo
+   128, so a panel which has missed one notices the gap and sends the
+   request again to resync. F0 7D 52 43 05 F7 ends the subscription.
+
+   STATE_SYNC_Update() is called each mS with the current state. It keeps
+   the state last sent and sends at most one frame per STATE_SYNC_INTERVAL:
+   a delta with one changed field takes 10 bytes, each further field 2
+   more. If more than half of the fields have changed, the full state is
+   sent instead.
+*/
+
+/////////////////////////////////////////////////////////////////////////////
+// Include files
+/////////////////////////////////////////////////////////////////////////////
+
+#include <mios32.h>
+#include <string.h>
+#include "state_sync.h"
+#include "sysex.h"
+
+static mios32_midi_port_t port;
+static volatile u8 subscribed;
+static volatile u8 fullRequested;
+static u8 sent[STATE_BYTES];    // the state as the panel knows it
+static u8 sequence;
+static u8 holdOff;              // mS until the next delta may be sent
+
+// header, version, sequence, count/first field + 2 bytes per field, F7
+static u8 frame[7 + 2 * STATE_BYTES + 1];
+
+/////////////////////////////////////////////////////////////////////////////
+// writes the header of a frame, returns the position behind it
+/////////////////////////////////////////////////////////////////////////////
+static u8 *beginFrame(u8 command)
+{
+    u8 *f = frame;
+    *f++ = 0xf0;
+    *f++ = SYSEX_ID;
+    *f++ = SYSEX_ID_1;
+    *f++ = SYSEX_ID_2;
+    *f++ = command;
+    *f++ = STATE_SYNC_VERSION;
+    *f++ = sequence;
+    sequence = (sequence + 1) & 0x7f;
+    return f;
+}
+
+static void sendFrame(u8 *end)
+{
+    *end++ = 0xf7;
+    MIOS32_MIDI_SendSysEx(port, frame, end - frame);
+    holdOff = STATE_SYNC_INTERVAL;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// Initializes the protocol, the state is sent to the given port once a
+// panel has subscribed
+/////////////////////////////////////////////////////////////////////////////
+s32 STATE_SYNC_Init(mios32_midi_port_t _port)
+{
+    port = _port;
+    subscribed = 0;
+    fullRequested = 0;
+    sequence = 0;
+    holdOff = 0;
+    return 0;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// Subscribes the panel, the full state is sent on the next update
+/////////////////////////////////////////////////////////////////////////////
+void STATE_SYNC_Request(void)
+{
+    fullRequested = 1;
+    subscribed = 1;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// Ends the subscription
+/////////////////////////////////////////////////////////////////////////////
+void STATE_SYNC_Stop(void)
+{
+    subscribed = 0;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// Sends the changes of the state since the last frame, or the full state if
+// it has been requested. Call it each mS.
+/////////////////////////////////////////////////////////////////////////////
+void STATE_SYNC_Update(const u8 *state)
+{
+    if (holdOff)
+        holdOff--;
+    if (!subscribed)
+        return;
+
+    int changed = 0;
+    int i;
+    if (!fullRequested)
+    {
+        if (holdOff)
+            return;
+        for (i = 0; i < STATE_BYTES; i++)
+            if (state[i] != sent[i])
+                changed++;
+        if (!changed)
+            return;
+    }
+
+    u8 *f;
+    if (fullRequested || (changed > STATE_BYTES / 2))
+    {
+        fullRequested = 0;
+        f = beginFrame(SYSEX_STATE_FULL);
+        *f++ = STATE_BYTES;
+        for (i = 0; i < STATE_BYTES; i++)
+            *f++ = state[i] & 0x7f;
+    }
+    else
+    {
+        f = beginFrame(SYSEX_STATE_DELTA);
+        for (i = 0; i < STATE_BYTES; i++)
+        {
+            if (state[i] != sent[i])
+            {
+                *f++ = i;
+                *f++ = state[i] & 0x7f;
+            }
+        }
+    }
+    memcpy(sent, state, STATE_BYTES);
+    sendFrame(f);
+}
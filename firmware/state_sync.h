@@ -0,0 +1,59 @@
+/*
+ * Header file of the state sync protocol
+ *
+ * ==========================================================================
+ *
+ *  Licensed for personal non-commercial use only.
+ *  All other rights reserved.
+ *
+ * ==========================================================================
+ */
+
+#ifndef _STATE_SYNC_H
+#define _STATE_SYNC_H
+
+
+/////////////////////////////////////////////////////////////////////////////
+// Global definitions
+/////////////////////////////////////////////////////////////////////////////
+
+// version of the state layout, sent with every frame. New fields are only
+// appended, a panel ignores the bytes it doesn't know.
+#define STATE_SYNC_VERSION 2
+
+// the deltas are sent at most once per interval, changes in between are
+// combined into one frame
+#define STATE_SYNC_INTERVAL 10 // mS
+
+// layout of the state, one byte (0..127) per field. The scene and the
+// track mutes are those of the first target.
+#define STATE_SCENE         0   // current scene 0..12 (0 == off), 127 == none
+#define STATE_QUEUED_SCENE  1   // scene queued for the next sync point, 127 == none
+#define STATE_MUTES         2   // track mutes: tracks 1..7 (bit 0 == track 1), tracks 8..12
+#define STATE_QUEUED_MUTES  4   // track mutes after the next sync point, same format
+#define STATE_FLAGS         6   // STATE_FLAG_*
+#define STATE_TEMPO         7   // tempo in 1/10 BPM (2 bytes, MSB first), 0 == unknown
+#define STATE_SETTINGS      9   // the 64 bits of the settings, 7 bits per byte, LSB first
+#define STATE_SETTINGS_BYTES 10
+// version 2
+#define STATE_SELECTED      19  // bit flags: the targets the buttons change
+#define STATE_TARGET_2      20  // scene, queued scene, mutes and queued mutes of the second target (6 bytes)
+#define STATE_BYTES         26
+
+#define STATE_FLAG_KILL        0x01 // performance kill active
+#define STATE_FLAG_QUEUED_KILL 0x02 // kill state after the next sync point
+#define STATE_FLAG_RUNNING     0x04 // the clock of the sync source is running
+#define STATE_FLAG_SETTINGS    0x08 // a settings page is shown
+
+
+/////////////////////////////////////////////////////////////////////////////
+// Prototypes
+/////////////////////////////////////////////////////////////////////////////
+
+extern s32 STATE_SYNC_Init(mios32_midi_port_t port);
+extern void STATE_SYNC_Request(void);
+extern void STATE_SYNC_Stop(void);
+extern void STATE_SYNC_Update(const u8 *state);
+
+
+#endif /* _STATE_SYNC_H */
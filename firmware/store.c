@@ -0,0 +1,174 @@
+/* Journaled settings store in the emulated EEPROM.
+
+   Each record (the settings, the routing matrix, the target maps) is kept in two slots of
+   its own. A record consists of
+        word 0:      sequence number, incremented with each save
+        word 1:      format (upper byte) and number of data words
+        word 2..n+1: data
+        word n+2:    CRC-16 over the words before
+   A save goes to the slot which doesn't hold the newest record, the CRC
+   is written last. If the save is torn (power loss), the CRC of that slot
+   doesn't match and the record in the other slot, the last known good
+   one, is used on the next boot.
+
+   The flash pages of the EEPROM emulation fill up with each written word
+   and have to be copied and erased when full, which stalls the caller. So
+   a save which doesn't change anything writes nothing, and otherwise only
+   the words which differ from what the slot already holds are written.
+*/
+
+/////////////////////////////////////////////////////////////////////////////
+// Include files
+/////////////////////////////////////////////////////////////////////////////
+
+#include <mios32.h>
+#include <eeprom.h>
+#include "store.h"
+
+#define SLOT_WORDS (STORE_MAX_WORDS + 3)
+
+typedef struct
+{
+    s32 words[SLOT_WORDS];  // content of the EEPROM, -1 == not programmed
+    u8 valid;
+} slot_t;
+
+static slot_t slots[STORE_NUM_RECORDS][2];
+static s8 newest[STORE_NUM_RECORDS] = { -1, -1, -1 }; // slot with the newest valid record, -1 == none
+
+static const u16 slotAddress[STORE_NUM_RECORDS][2] =
+{
+    { STORE_SETTINGS_SLOT_A, STORE_SETTINGS_SLOT_B },
+    { STORE_ROUTES_SLOT_A, STORE_ROUTES_SLOT_B },
+    { STORE_TARGETS_SLOT_A, STORE_TARGETS_SLOT_B }
+};
+static const u8 maxWords[STORE_NUM_RECORDS] = { STORE_SETTINGS_WORDS, STORE_ROUTES_WORDS, STORE_TARGETS_WORDS };
+
+/////////////////////////////////////////////////////////////////////////////
+// CRC-16/CCITT of a number of words
+/////////////////////////////////////////////////////////////////////////////
+static u16 crc16(const s32 *words, int num)
+{
+    u16 crc = 0xffff;
+    int i, bit;
+    for (i = 0; i < num; i++)
+    {
+        crc ^= (u16)words[i];
+        for (bit = 0; bit < 16; bit++)
+            crc = (crc & 0x8000) ? ((crc << 1) ^ 0x1021) : (crc << 1);
+    }
+    return crc;
+}
+
+static u8 numWords(const slot_t *slot)
+{
+    return slot->words[1] & 0xff;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// reads a slot and checks its record
+/////////////////////////////////////////////////////////////////////////////
+static void readSlot(u8 record, int s)
+{
+    slot_t *slot = &slots[record][s];
+    int i;
+    for (i = 0; i < maxWords[record] + 3; i++)
+        slot->words[i] = EEPROM_Read(slotAddress[record][s] + i);
+
+    slot->valid = 0;
+    if ((slot->words[0] < 0) || (slot->words[1] < 0) || ((slot->words[1] >> 8) != STORE_FORMAT))
+        return;
+    u8 num = numWords(slot);
+    if (num > maxWords[record])
+        return;
+    for (i = 2; i < num + 2; i++)
+        if (slot->words[i] < 0)
+            return;
+    slot->valid = (slot->words[num + 2] == crc16(slot->words, num + 2));
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// Loads the newest valid record. Data words which are not part of the
+// record are left untouched. Returns the number of words loaded or -1 if
+// there is no valid record.
+/////////////////////////////////////////////////////////////////////////////
+s32 STORE_Load(u8 record, u16 *words, u8 num)
+{
+    if (record >= STORE_NUM_RECORDS)
+        return -1;
+
+    slot_t *slot = slots[record];
+    readSlot(record, 0);
+    readSlot(record, 1);
+
+    s8 n = -1;
+    if (slot[0].valid && slot[1].valid)
+        // the sequence number wraps around
+        n = ((s16)(slot[1].words[0] - slot[0].words[0]) > 0) ? 1 : 0;
+    else if (slot[0].valid)
+        n = 0;
+    else if (slot[1].valid)
+        n = 1;
+    newest[record] = n;
+    if (n < 0)
+        return -1;
+
+    slot = &slot[n];
+    u8 stored = numWords(slot);
+    int i;
+    for (i = 0; i < num && i < stored; i++)
+        words[i] = slot->words[i + 2];
+    return i;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// Saves a record if it differs from the newest one. Returns the number of
+// EEPROM words written or the error of EEPROM_Write (< 0).
+/////////////////////////////////////////////////////////////////////////////
+s32 STORE_Save(u8 record, const u16 *words, u8 num)
+{
+    if ((record >= STORE_NUM_RECORDS) || (num > maxWords[record]))
+        return -4;
+
+    slot_t *slot = slots[record];
+    s8 n = newest[record];
+    int i;
+    if (n >= 0 && numWords(&slot[n]) == num)
+    {
+        for (i = 0; i < num; i++)
+            if (slot[n].words[i + 2] != words[i])
+                break;
+        if (i == num)
+            return 0;
+    }
+
+    // the record which is about to be written, into the other slot
+    int s = (n == 0) ? 1 : 0;
+    s32 data[SLOT_WORDS];
+    data[0] = (n >= 0) ? (u16)(slot[n].words[0] + 1) : 0;
+    data[1] = (STORE_FORMAT << 8) | num;
+    for (i = 0; i < num; i++)
+        data[i + 2] = words[i];
+    data[num + 2] = crc16(data, num + 2);
+
+    // invalidate the slot first (the CRC is written last), then write the
+    // words which differ
+    slot[s].valid = 0;
+    s32 written = 0;
+    for (i = 0; i < num + 3; i++)
+    {
+        int w = (i == num + 2) ? i : (i + 2) % (num + 2); // data, header, CRC
+        if (slot[s].words[w] == data[w])
+            continue;
+
+        s32 result = EEPROM_Write(slotAddress[record][s] + w, data[w]);
+        if (result < 0)
+            return result;
+        slot[s].words[w] = data[w];
+        written++;
+    }
+
+    slot[s].valid = 1;
+    newest[record] = s;
+    return written;
+}
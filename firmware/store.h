@@ -0,0 +1,55 @@
+/*
+ * Header file of the journaled settings store
+ *
+ * ==========================================================================
+ *
+ *  Licensed for personal non-commercial use only.
+ *  All other rights reserved.
+ *
+ * ==========================================================================
+ */
+
+#ifndef _STORE_H
+#define _STORE_H
+
+
+/////////////////////////////////////////////////////////////////////////////
+// Global definitions
+/////////////////////////////////////////////////////////////////////////////
+
+// records, the EEPROM addresses (halfwords) of their two slots and their
+// max. number of data words (a slot holds 3 more words)
+#define STORE_SETTINGS        0
+#define STORE_SETTINGS_SLOT_A 16
+#define STORE_SETTINGS_SLOT_B 32
+#define STORE_SETTINGS_WORDS  13
+
+#define STORE_ROUTES          1
+#define STORE_ROUTES_SLOT_A   64
+#define STORE_ROUTES_SLOT_B   96
+#define STORE_ROUTES_WORDS    29
+
+#define STORE_TARGETS         2
+#define STORE_TARGETS_SLOT_A  128
+#define STORE_TARGETS_SLOT_B  160
+#define STORE_TARGETS_WORDS   18
+
+#define STORE_NUM_RECORDS     3
+
+// max. number of data words of any record
+#define STORE_MAX_WORDS 29
+
+// format of the record. Fields are only ever appended to the settings,
+// records with fewer words stay valid.
+#define STORE_FORMAT 1
+
+
+/////////////////////////////////////////////////////////////////////////////
+// Prototypes
+/////////////////////////////////////////////////////////////////////////////
+
+extern s32 STORE_Load(u8 record, u16 *words, u8 num);
+extern s32 STORE_Save(u8 record, const u16 *words, u8 num);
+
+
+#endif /* _STORE_H */
@@ -0,0 +1,162 @@
+/* SysEx commands of the controller.
+
+   The commands are received on USB0. Like the settings dump of the Rytm
+   (rytm_dump.c), they are parsed as the SysEx packages arrive:
+
+        F0 7D 52 43 <command> [<data>...] F7
+
+   Up to SYSEX_DATA_MAX data bytes are kept for the command. A longer
+   command still belongs to the controller until its F7, SYSEX_Owner()
+   reports SYSEX_IGNORED with the package which ends it. Any other SysEx
+   passes unnoticed.
+
+   The commands are meant for the controller only, so they are not
+   forwarded. SYSEX_Owner() tells after each package whether it belongs to
+   a command. The first package (F0 7D 52) only carries a part of the
+   header, it is SYSEX_MAYBE until the next one shows whether the message
+   is a command.
+*/
+
+/////////////////////////////////////////////////////////////////////////////
+// Include files
+/////////////////////////////////////////////////////////////////////////////
+
+#include <mios32.h>
+#include "sysex.h"
+
+static const u8 header[] = { SYSEX_ID, SYSEX_ID_1, SYSEX_ID_2 };
+
+// position in the message, IDLE outside of a command, OVERFLOW behind
+// SYSEX_DATA_MAX data bytes
+#define IDLE     0xff
+#define OVERFLOW 0xfe
+static u8 pos;
+static u8 ignored;  // the last package has ended a command which was too long
+static s16 command;
+static u8 data[SYSEX_DATA_MAX];
+static u8 dataLength;
+static u8 owner;    // SYSEX_NONE, SYSEX_MAYBE or SYSEX_COMMAND
+
+/////////////////////////////////////////////////////////////////////////////
+// feeds one byte into the parser. Returns the command once it is complete,
+// otherwise -1.
+/////////////////////////////////////////////////////////////////////////////
+static s32 parseByte(u8 b)
+{
+    if (b >= 0xf8)
+        return -1; // realtime messages may be interleaved
+
+    if (b == 0xf0)
+    {
+        pos = 0;
+        command = -1;
+        return -1;
+    }
+    if (pos == IDLE)
+        return -1;
+
+    if (b == 0xf7)
+    {
+        s32 complete = ((pos > sizeof(header)) && (pos != OVERFLOW)) ? command : -1;
+        ignored = (pos == OVERFLOW);
+        pos = IDLE;
+        return complete;
+    }
+    if ((b >= 0x80) || ((pos < sizeof(header)) && (b != header[pos])))
+    {
+        pos = IDLE; // not a command of the controller
+        return -1;
+    }
+    if (pos == OVERFLOW)
+        return -1;
+
+    if (pos == sizeof(header))
+    {
+        command = b;
+        dataLength = 0;
+        pos++;
+    }
+    else if (pos > sizeof(header))
+    {
+        if (dataLength >= SYSEX_DATA_MAX)
+            pos = OVERFLOW; // owned until the F7, but dropped
+        else
+            data[dataLength++] = b;
+    }
+    else
+        pos++;
+    return -1;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// Initializes the parser
+/////////////////////////////////////////////////////////////////////////////
+s32 SYSEX_Init(void)
+{
+    pos = IDLE;
+    command = -1;
+    dataLength = 0;
+    ignored = 0;
+    owner = SYSEX_NONE;
+    return 0;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// Parses a received package. Returns the command if it has completed one,
+// otherwise -1.
+/////////////////////////////////////////////////////////////////////////////
+s32 SYSEX_Parse(mios32_midi_package_t package)
+{
+    u8 len;
+    switch (package.type)
+    {
+        case 0x4: len = 3; break;   // SysEx starts or continues
+        case 0x5: len = 1; break;   // SysEx ends with 1 byte, or single byte system common
+        case 0x6: len = 2; break;
+        case 0x7: len = 3; break;
+        case 0xf: len = 1; break;   // single byte
+        default:
+            pos = IDLE;             // channel messages end the SysEx
+            owner = SYSEX_NONE;
+            return -1;
+    }
+
+    ignored = 0;
+    s32 complete = parseByte(package.evnt0);
+    if ((len >= 2) && (complete < 0))
+        complete = parseByte(package.evnt1);
+    if ((len >= 3) && (complete < 0))
+        complete = parseByte(package.evnt2);
+
+    // realtime messages in between don't belong to the command
+    if ((package.type < 0x4) || (package.type > 0x7))
+        owner = SYSEX_NONE;
+    else if (ignored)
+        owner = SYSEX_IGNORED;
+    else if ((complete >= 0) || ((pos != IDLE) && (pos > sizeof(header))))
+        owner = SYSEX_COMMAND;
+    else if (pos != IDLE)
+        owner = SYSEX_MAYBE;
+    else
+        owner = SYSEX_NONE;
+    return complete;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// Returns whether the last parsed package belongs to a command:
+// SYSEX_COMMAND if it does, SYSEX_MAYBE if the header is not complete yet,
+// SYSEX_IGNORED if it has ended a command which was too long
+/////////////////////////////////////////////////////////////////////////////
+u8 SYSEX_Owner(void)
+{
+    return owner;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// Returns the data bytes of the last command
+/////////////////////////////////////////////////////////////////////////////
+const u8 *SYSEX_DataGet(u8 *length)
+{
+    *length = dataLength;
+    return data;
+}
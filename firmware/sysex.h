@@ -0,0 +1,61 @@
+/*
+ * Header file of the SysEx commands of the controller
+ *
+ * ==========================================================================
+ *
+ *  Licensed for personal non-commercial use only.
+ *  All other rights reserved.
+ *
+ * ==========================================================================
+ */
+
+#ifndef _SYSEX_H
+#define _SYSEX_H
+
+
+/////////////////////////////////////////////////////////////////////////////
+// Global definitions
+/////////////////////////////////////////////////////////////////////////////
+
+// header of the messages: the manufacturer ID for non-commercial use and
+// "RC" (Rytm Controller)
+#define SYSEX_ID      0x7d
+#define SYSEX_ID_1    0x52
+#define SYSEX_ID_2    0x43
+
+// commands, F0 7D 52 43 <command> F7
+#define SYSEX_PROFILE_REPORT 0x01   // print the profiler results
+#define SYSEX_PROFILE_RESET  0x02   // clear the profiler results
+#define SYSEX_TRACE_DUMP     0x03   // send the trace (see trace.c)
+#define SYSEX_STATE_REQUEST  0x04   // subscribe to the state, send it in full (see state_sync.c)
+#define SYSEX_STATE_STOP     0x05   // end the subscription
+#define SYSEX_TARGET_MAP     0x06   // <target> <map>: load the mapping of a target (see app.c)
+#define SYSEX_TARGET_REQUEST 0x07   // <target>: send the mapping of a target as SYSEX_TARGET_MAP
+#define SYSEX_ROUTE          0x08   // <source> <destination> <filter>: load a route of the matrix (see app.c)
+#define SYSEX_ROUTE_REQUEST  0x09   // <source> <destination>: send a route as SYSEX_ROUTE
+
+// max. number of data bytes behind the command
+#define SYSEX_DATA_MAX 24
+
+// SYSEX_Owner(): does the last package belong to a command?
+#define SYSEX_NONE    0
+#define SYSEX_MAYBE   1 // only a part of the header has been received
+#define SYSEX_COMMAND 2
+#define SYSEX_IGNORED 3 // ends a command which was too long, it is dropped
+
+// frames sent by the controller
+#define SYSEX_STATE_FULL     0x10   // the full state
+#define SYSEX_STATE_DELTA    0x11   // the fields which have changed
+
+
+/////////////////////////////////////////////////////////////////////////////
+// Prototypes
+/////////////////////////////////////////////////////////////////////////////
+
+extern s32 SYSEX_Init(void);
+extern s32 SYSEX_Parse(mios32_midi_package_t package);
+extern const u8 *SYSEX_DataGet(u8 *length);
+extern u8 SYSEX_Owner(void);
+
+
+#endif /* _SYSEX_H */
@@ -0,0 +1,153 @@
+/* Tempo tracker for the incoming MIDI clock.
+
+   A second order phase locked loop follows the timestamps of the 0xF8 ticks.
+   For each tick the phase error between the expected and the actual time is
+   measured. A quarter of it corrects the phase, 1/64 of it corrects the tick
+   interval (critically damped). Jitter of the clock source is averaged out,
+   tempo changes are followed within a few beats. Until the loop is locked,
+   it runs with a wider bandwidth (1/2 and 1/16) to settle quickly. A phase error of more than
+   half an interval is treated as a tempo jump and restarts the tracking.
+
+   The interval is kept in 1/256 uS, all calculations are integer.
+*/
+
+/////////////////////////////////////////////////////////////////////////////
+// Include files
+/////////////////////////////////////////////////////////////////////////////
+
+#include <mios32.h>
+#include "tempo.h"
+
+#define PHASE_GAIN_SHIFT     2  // phase correction: error / 4
+#define FREQUENCY_GAIN_SHIFT 6  // interval correction: error / 64
+#define CAPTURE_PHASE_SHIFT  1  // gains while capturing
+#define CAPTURE_FREQ_SHIFT   4
+#define JITTER_SHIFT         3  // jitter average over ~8 ticks
+#define FRACTION_BITS        8
+
+static u32 numTicks;     // ticks since the tracking has been (re)started
+static u32 lastTime;     // time of the last tick
+static u32 phase;        // filtered time of the last tick
+static s32 interval;     // filtered tick interval in 1/256 uS
+static u32 jitter;       // mean absolute phase error in uS
+
+/////////////////////////////////////////////////////////////////////////////
+// forgets the tempo
+/////////////////////////////////////////////////////////////////////////////
+s32 TEMPO_Init(void)
+{
+    numTicks = 0;
+    lastTime = 0;
+    phase = 0;
+    interval = 0;
+    jitter = 0;
+    return 0;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// feeds a clock tick which has been received at the given time (uS)
+/////////////////////////////////////////////////////////////////////////////
+s32 TEMPO_Clock(u32 time)
+{
+    u32 measured = time - lastTime;
+    lastTime = time;
+
+    if (numTicks && (measured >= TEMPO_INTERVAL_MAX))
+        numTicks = 0;
+
+    if (numTicks < 2)
+    {
+        // the first interval seeds the loop
+        if (numTicks == 1)
+        {
+            interval = measured << FRACTION_BITS;
+            jitter = 0;
+        }
+        phase = time;
+        numTicks++;
+        return 0;
+    }
+
+    u32 expected = phase + (interval >> FRACTION_BITS);
+    s32 error = (s32)(time - expected);
+    s32 absError = (error < 0) ? -error : error;
+
+    if (absError > (interval >> (FRACTION_BITS + 1)))
+    {
+        // tempo jump: start over with the measured interval
+        interval = measured << FRACTION_BITS;
+        phase = time;
+        numTicks = 2;
+        return 0;
+    }
+
+    if (numTicks < TEMPO_LOCK_TICKS)
+    {
+        phase = expected + (error >> CAPTURE_PHASE_SHIFT);
+        interval += error * (1 << (FRACTION_BITS - CAPTURE_FREQ_SHIFT));
+    }
+    else
+    {
+        phase = expected + (error >> PHASE_GAIN_SHIFT);
+        interval += error * (1 << (FRACTION_BITS - FREQUENCY_GAIN_SHIFT));
+    }
+    jitter += (s32)(absError - jitter) >> JITTER_SHIFT;
+    numTicks++;
+    return 0;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// returns 1 once the loop has followed the clock for a while
+/////////////////////////////////////////////////////////////////////////////
+u8 TEMPO_IsLocked(void)
+{
+    return numTicks >= TEMPO_LOCK_TICKS;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// returns the filtered tick interval in uS, or 0 if unknown
+/////////////////////////////////////////////////////////////////////////////
+u32 TEMPO_IntervalGet(void)
+{
+    if (numTicks < 2)
+        return 0;
+    return interval >> FRACTION_BITS;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// returns the tempo in 1/10 BPM (24 ticks per quarter note), or 0 if unknown
+/////////////////////////////////////////////////////////////////////////////
+u32 TEMPO_BpmGet(void)
+{
+    if ((numTicks < 2) || (interval <= 0))
+        return 0;
+    // 60 s * 10 / 24 ticks, rounded
+    return (u32)((((u64)600000000 << FRACTION_BITS) / 24 + interval / 2) / interval);
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// returns the mean deviation of the ticks from the tracked tempo in uS
+/////////////////////////////////////////////////////////////////////////////
+u32 TEMPO_JitterGet(void)
+{
+    return jitter;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// returns the expected time of the given number of ticks after the last one
+/////////////////////////////////////////////////////////////////////////////
+u32 TEMPO_PredictTime(u32 ticks)
+{
+    return phase + (u32)(((s64)interval * ticks) >> FRACTION_BITS);
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// returns the time without a tick (uS) after which the clock has stopped
+/////////////////////////////////////////////////////////////////////////////
+u32 TEMPO_TimeoutGet(void)
+{
+    if (numTicks < 2)
+        return TEMPO_TIMEOUT_DEFAULT;
+    u32 timeout = TEMPO_TIMEOUT_TICKS * (interval >> FRACTION_BITS) + 4 * jitter;
+    return (timeout < TEMPO_TIMEOUT_DEFAULT) ? timeout : TEMPO_TIMEOUT_DEFAULT;
+}
@@ -0,0 +1,48 @@
+/*
+ * Header file of the clock tempo tracker
+ *
+ * ==========================================================================
+ *
+ *  Licensed for personal non-commercial use only.
+ *  All other rights reserved.
+ *
+ * ==========================================================================
+ */
+
+#ifndef _TEMPO_H
+#define _TEMPO_H
+
+
+/////////////////////////////////////////////////////////////////////////////
+// Global definitions
+/////////////////////////////////////////////////////////////////////////////
+
+// longer pauses between two clock ticks (uS) restart the tracking
+#define TEMPO_INTERVAL_MAX 250000
+
+// the stop timeout is this number of expected tick intervals (plus jitter)
+#define TEMPO_TIMEOUT_TICKS 3
+
+// timeout (uS) as long as the tempo is unknown
+#define TEMPO_TIMEOUT_DEFAULT 500000
+
+// consecutive ticks within the capture range until the loop counts as locked
+#define TEMPO_LOCK_TICKS 24
+
+
+/////////////////////////////////////////////////////////////////////////////
+// Prototypes
+/////////////////////////////////////////////////////////////////////////////
+
+extern s32 TEMPO_Init(void);
+extern s32 TEMPO_Clock(u32 time);
+
+extern u8  TEMPO_IsLocked(void);
+extern u32 TEMPO_IntervalGet(void);
+extern u32 TEMPO_BpmGet(void);
+extern u32 TEMPO_JitterGet(void);
+extern u32 TEMPO_PredictTime(u32 ticks);
+extern u32 TEMPO_TimeoutGet(void);
+
+
+#endif /* _TEMPO_H */
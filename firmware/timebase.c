@@ -0,0 +1,52 @@
+/* Free running uS time base.
+
+   Derived from the DWT cycle counter of the Cortex-M core. The 32 bit cycle
+   counter wraps after 25 seconds at 168 MHz, so TIMEBASE_Get() has to be
+   called at least that often (APP_Tick does so each mS). The returned time
+   wraps after ~71 minutes; always compare timestamps by subtraction.
+*/
+
+/////////////////////////////////////////////////////////////////////////////
+// Include files
+/////////////////////////////////////////////////////////////////////////////
+
+#include <mios32.h>
+#include "timebase.h"
+
+static u32 cyclesPerUs;
+static u32 lastCycles;
+static u32 timeUs;
+
+/////////////////////////////////////////////////////////////////////////////
+// enables the cycle counter and resets the time base to 0
+/////////////////////////////////////////////////////////////////////////////
+s32 TIMEBASE_Init(void)
+{
+    cyclesPerUs = SystemCoreClock / 1000000;
+
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CYCCNT = 0;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+
+    lastCycles = 0;
+    timeUs = 0;
+    return 0;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// returns the current time in uS. Can be called from any context.
+/////////////////////////////////////////////////////////////////////////////
+u32 TIMEBASE_Get(void)
+{
+    u32 now;
+
+    MIOS32_IRQ_Disable();
+    u32 elapsed = (DWT->CYCCNT - lastCycles) / cyclesPerUs;
+    // keep the remainder in lastCycles so no fractions are lost
+    lastCycles += elapsed * cyclesPerUs;
+    timeUs += elapsed;
+    now = timeUs;
+    MIOS32_IRQ_Enable();
+
+    return now;
+}
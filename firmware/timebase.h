@@ -0,0 +1,24 @@
+/*
+ * Header file of the uS time base
+ *
+ * ==========================================================================
+ *
+ *  Licensed for personal non-commercial use only.
+ *  All other rights reserved.
+ *
+ * ==========================================================================
+ */
+
+#ifndef _TIMEBASE_H
+#define _TIMEBASE_H
+
+
+/////////////////////////////////////////////////////////////////////////////
+// Prototypes
+/////////////////////////////////////////////////////////////////////////////
+
+extern s32 TIMEBASE_Init(void);
+extern u32 TIMEBASE_Get(void);
+
+
+#endif /* _TIMEBASE_H */
@@ -0,0 +1,146 @@
+/* Trace of the MIDI traffic and the user input.
+
+   To find out afterwards why a change has landed late, the last TRACE_SIZE
+   events are kept in a ring: every MIDI byte received or sent on USB0,
+   UART0 and UART1, the buttons, the pots, the sync points and the queued
+   changes when they are fired. Recording an event takes a timestamp and
+   an 8 byte copy with the interrupts disabled; the oldest events are
+   overwritten.
+
+   TRACE_Dump() sends the ring, oldest event first, as SysEx messages:
+
+        F0 7D 52 43 03 <number MSB> <number LSB> <packed events> F7
+
+   The events are 7 bit packed like the dumps of the Rytm: each group of 7
+   bytes is preceded by a byte with their MSBs (bit 6 belongs to the first
+   byte). Recording pauses during the dump. The decoder for the host is
+   host/trace_decode.c.
+*/
+
+/////////////////////////////////////////////////////////////////////////////
+// Include files
+/////////////////////////////////////////////////////////////////////////////
+
+#include <mios32.h>
+#include "trace.h"
+#include "sysex.h"
+#include "timebase.h"
+
+static traceEvent_t ring[TRACE_SIZE];
+static u32 recorded;        // number of events recorded since the init
+static volatile u8 paused;
+
+// one message of the dump: header, number, packed events, F7
+#define DUMP_BYTES (TRACE_DUMP_EVENTS * sizeof(traceEvent_t))
+static u8 message[7 + (DUMP_BYTES + 6) / 7 * 8 + 1];
+
+/////////////////////////////////////////////////////////////////////////////
+// returns the index of a port in the event type
+/////////////////////////////////////////////////////////////////////////////
+static u8 portIndex(mios32_midi_port_t port)
+{
+    return (port == USB0) ? 0 : (port == UART0) ? 1 : 2;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// Initializes the trace, clears all events
+/////////////////////////////////////////////////////////////////////////////
+s32 TRACE_Init(void)
+{
+    recorded = 0;
+    paused = 0;
+    return 0;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// Records an event with the current time. data holds up to 3 bytes, LSB
+// first. Can be called from any context.
+/////////////////////////////////////////////////////////////////////////////
+void TRACE_Record(u8 type, u32 data)
+{
+    TRACE_RecordAt(TIMEBASE_Get(), type, data);
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// Records an event which has occurred at the given time
+/////////////////////////////////////////////////////////////////////////////
+void TRACE_RecordAt(u32 time, u8 type, u32 data)
+{
+    if (paused)
+        return;
+
+    MIOS32_IRQ_Disable();
+    traceEvent_t *e = &ring[recorded++ & (TRACE_SIZE - 1)];
+    e->time = time;
+    e->type = type;
+    e->data[0] = data;
+    e->data[1] = data >> 8;
+    e->data[2] = data >> 16;
+    MIOS32_IRQ_Enable();
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// Records a received MIDI byte
+/////////////////////////////////////////////////////////////////////////////
+void TRACE_MidiIn(mios32_midi_port_t port, u8 midi_byte)
+{
+    TRACE_Record(TRACE_MIDI_IN | portIndex(port), midi_byte);
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// Records a sent MIDI byte
+/////////////////////////////////////////////////////////////////////////////
+void TRACE_MidiOut(mios32_midi_port_t port, u8 midi_byte)
+{
+    TRACE_Record(TRACE_MIDI_OUT | portIndex(port), midi_byte);
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// Sends the recorded events as SysEx messages
+/////////////////////////////////////////////////////////////////////////////
+s32 TRACE_Dump(mios32_midi_port_t port)
+{
+    paused = 1;
+
+    u32 num = (recorded < TRACE_SIZE) ? recorded : TRACE_SIZE;
+    u32 first = recorded - num;
+    u32 sent;
+    u16 number = 0;
+    for (sent = 0; sent < num; number++)
+    {
+        u8 *m = message;
+        *m++ = 0xf0;
+        *m++ = SYSEX_ID;
+        *m++ = SYSEX_ID_1;
+        *m++ = SYSEX_ID_2;
+        *m++ = SYSEX_TRACE_DUMP;
+        *m++ = (number >> 7) & 0x7f;
+        *m++ = number & 0x7f;
+
+        // pack the events, 7 bytes per group
+        u8 *msbs = m;
+        int packed = 0;
+        int e;
+        for (e = 0; (e < TRACE_DUMP_EVENTS) && (sent < num); e++, sent++)
+        {
+            const u8 *b = (const u8 *)&ring[(first + sent) & (TRACE_SIZE - 1)];
+            int i;
+            for (i = 0; i < sizeof(traceEvent_t); i++, packed++)
+            {
+                if ((packed % 7) == 0)
+                {
+                    msbs = m++;
+                    *msbs = 0;
+                }
+                *msbs |= (b[i] & 0x80) >> (1 + packed % 7);
+                *m++ = b[i] & 0x7f;
+            }
+        }
+        *m++ = 0xf7;
+
+        MIOS32_MIDI_SendSysEx(port, message, m - message);
+    }
+
+    paused = 0;
+    return sent;
+}
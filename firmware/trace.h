@@ -0,0 +1,60 @@
+/*
+ * Header file of the event trace
+ *
+ * ==========================================================================
+ *
+ *  Licensed for personal non-commercial use only.
+ *  All other rights reserved.
+ *
+ * ==========================================================================
+ */
+
+#ifndef _TRACE_H
+#define _TRACE_H
+
+
+/////////////////////////////////////////////////////////////////////////////
+// Global definitions
+/////////////////////////////////////////////////////////////////////////////
+
+// number of events in the ring (must be a power of 2), 8 bytes each
+#define TRACE_SIZE 1024
+
+// events per SysEx message of the dump
+#define TRACE_DUMP_EVENTS 32
+
+// event types. The MIDI events are or'ed with the port: 0 == USB0,
+// 1 == UART0, 2 == UART1
+#define TRACE_MIDI_IN    0x00   // data: byte
+#define TRACE_MIDI_OUT   0x10   // data: byte
+#define TRACE_BUTTON     0x20   // data: pin, value (1 == released)
+#define TRACE_POT        0x30   // data: pot, 14 bit value (2 bytes, LSB first)
+#define TRACE_SYNC_POINT 0x40   // time of the clock tick, data: song position (3 bytes)
+#define TRACE_ACTION     0x50   // data: action flags, song position of the sync point (2 bytes)
+
+
+/////////////////////////////////////////////////////////////////////////////
+// Global Types
+/////////////////////////////////////////////////////////////////////////////
+
+typedef struct __attribute__((packed))
+{
+    u32 time;       // uS time base
+    u8 type;
+    u8 data[3];
+} traceEvent_t;
+
+
+/////////////////////////////////////////////////////////////////////////////
+// Prototypes
+/////////////////////////////////////////////////////////////////////////////
+
+extern s32 TRACE_Init(void);
+extern void TRACE_Record(u8 type, u32 data);
+extern void TRACE_RecordAt(u32 time, u8 type, u32 data);
+extern void TRACE_MidiIn(mios32_midi_port_t port, u8 midi_byte);
+extern void TRACE_MidiOut(mios32_midi_port_t port, u8 midi_byte);
+extern s32 TRACE_Dump(mios32_midi_port_t port);
+
+
+#endif /* _TRACE_H */